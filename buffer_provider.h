@@ -0,0 +1,905 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <boost/core/noncopyable.hpp>
+#include <liburing.h>
+#include <sys/mman.h>
+
+#include "buffers.h"
+#include "rx_config.h"
+#include "util.h"
+
+// for building against older liburing/kernel headers
+#ifndef IOU_PBUF_RING_MMAP
+#define IOU_PBUF_RING_MMAP 1
+#endif
+#ifndef IORING_OFF_PBUF_RING
+#define IORING_OFF_PBUF_RING 0x80000000ULL
+#endif
+#ifndef IORING_OFF_PBUF_SHIFT
+#define IORING_OFF_PBUF_SHIFT 16
+#endif
+
+// a set of buffer indices that hands back maximal runs of consecutive ones.
+// returns cost the same whatever order they come in, and taking a run is
+// O(words) with no sorting
+class FreeBitmap {
+ public:
+  explicit FreeBitmap(size_t n = 0) : words_((n + 63) / 64), n_(n) {}
+
+  void set(size_t i) {
+    words_[i >> 6] |= 1LLU << (i & 63);
+  }
+
+  void setAll() {
+    std::fill(words_.begin(), words_.end(), ~0LLU);
+    if (n_ & 63) {
+      words_.back() = (1LLU << (n_ & 63)) - 1;
+    }
+  }
+
+  void clear() {
+    std::fill(words_.begin(), words_.end(), 0);
+  }
+
+  size_t count() const {
+    size_t ret = 0;
+    for (uint64_t w : words_) {
+      ret += __builtin_popcountll(w);
+    }
+    return ret;
+  }
+
+  // remove and return the first run (start, length) at or after where the
+  // last one ended, wrapping round. length is 0 if the set is empty
+  std::pair<size_t, size_t> take() {
+    size_t const nwords = words_.size();
+    for (size_t k = 0; k < nwords; k++) {
+      size_t w = cursor_ + k;
+      if (w >= nwords) {
+        w -= nwords;
+      }
+      if (!words_[w]) {
+        continue;
+      }
+      size_t const bit = __builtin_ctzll(words_[w]);
+      size_t const start = w * 64 + bit;
+      uint64_t const ones = words_[w] >> bit;
+      size_t len = ~ones ? __builtin_ctzll(~ones) : 64;
+      words_[w] &= len == 64 ? 0 : ~(((1LLU << len) - 1) << bit);
+      // a run up to the top bit can carry on into the following words
+      while (start + len == (w + 1) * 64 && w + 1 < nwords) {
+        uint64_t const next = words_[w + 1];
+        size_t const n = ~next ? __builtin_ctzll(~next) : 64;
+        if (!n) {
+          break;
+        }
+        words_[++w] = n == 64 ? 0 : next & ~((1LLU << n) - 1);
+        len += n;
+      }
+      cursor_ = w;
+      return {start, len};
+    }
+    return {0, 0};
+  }
+
+ private:
+  std::vector<uint64_t> words_;
+  size_t n_;
+  // word to start looking from
+  size_t cursor_ = 0;
+};
+
+// where a group of provided buffers sits: its group id, the id of its first
+// buffer, and how many buffers of what size it has
+struct BufferGroupLayout {
+  int bgid;
+  uint16_t first_bid;
+  size_t size;
+  size_t count;
+
+  static BufferGroupLayout single(IoUringRxConfig const& rx_cfg, int bgid) {
+    return BufferGroupLayout{
+        bgid,
+        0,
+        (size_t)rx_cfg.recv_size,
+        (size_t)rx_cfg.provided_buffer_count};
+  }
+};
+
+class BufferProviderV1 : private boost::noncopyable {
+ public:
+  static constexpr int kBgid = 1;
+
+  explicit BufferProviderV1(IoUringRxConfig const& rx_cfg)
+      : BufferProviderV1(rx_cfg, BufferGroupLayout::single(rx_cfg, kBgid)) {}
+
+  BufferProviderV1(IoUringRxConfig const& rx_cfg, BufferGroupLayout const& l)
+      : bgid_(l.bgid),
+        firstBid_(l.first_bid),
+        sizePerBuffer_(addAlignment(l.size)),
+        // the configured watermark is for provided_buffer_count buffers
+        lowWatermark_(
+            (int)l.count == rx_cfg.provided_buffer_count
+                ? rx_cfg.provided_buffer_low_watermark
+                : l.count / 4),
+        useBitmap_(rx_cfg.provided_buffer_bitmap),
+        free_(useBitmap_ ? l.count : 0) {
+    ssize_t const count = l.count;
+    // retired groups give their memory back, which needs it to be mapped
+    BufferOptions opts = rx_cfg.buffers;
+    opts.mmap |= rx_cfg.provided_buffer_max_groups > 1;
+    buffer_ = Buffer(count * sizePerBuffer_, opts);
+    for (ssize_t i = 0; i < count; i++) {
+      buffers_.push_back(buffer_.data() + i * sizePerBuffer_);
+    }
+    toProvide_.reserve(128);
+    toProvide2_.reserve(128);
+    reset();
+  }
+
+  size_t count() const {
+    return buffers_.size();
+  }
+
+  int bgid() const {
+    return bgid_;
+  }
+
+  size_t sizePerBuffer() const {
+    return sizePerBuffer_;
+  }
+
+  size_t toProvideCount() const {
+    return toProvideCount_;
+  }
+
+  bool canProvide() const {
+    return useBitmap_ ? toProvideCount_ > 0 : toProvide_.size() > 0;
+  }
+
+  bool needsToProvide() const {
+    return toProvideCount_ > lowWatermark_;
+  }
+
+  void initialRegister(struct io_uring*) {}
+
+  // take back whatever the kernel still has. anything handed out already
+  // must not be returned here
+  template <class GetSqe>
+  void unregister(struct io_uring*, GetSqe&& get_sqe) {
+    auto* sqe = get_sqe();
+    io_uring_prep_remove_buffers(sqe, count(), bgid_);
+    sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;
+    io_uring_sqe_set_data(sqe, NULL);
+    toProvide_.clear();
+    free_.clear();
+    toProvideCount_ = 0;
+  }
+
+  // every buffer needs providing again, only valid once all have come back
+  void reset() {
+    toProvide_.clear();
+    if (useBitmap_) {
+      free_.setAll();
+    } else {
+      toProvide_.emplace_back(firstBid_, count());
+    }
+    toProvideCount_ = count();
+  }
+
+  void discard() {
+    buffer_.discard();
+  }
+
+  void compact() {
+    if (useBitmap_ || toProvide_.size() <= 1) {
+      return;
+    } else if (toProvide_.size() == 2) {
+      // actually a common case due to the way the kernel internals work
+      if (toProvide_[0].merge(toProvide_[1])) {
+        toProvide_.pop_back();
+      }
+      return;
+    }
+    auto was = toProvide_.size();
+    std::sort(
+        toProvide_.begin(), toProvide_.end(), [](auto const& a, auto const& b) {
+          return a.sortable < b.sortable;
+        });
+    toProvide2_.clear();
+    toProvide2_.push_back(toProvide_[0]);
+    for (size_t i = 1; i < toProvide_.size(); i++) {
+      auto const& p = toProvide_[i];
+      if (!toProvide2_.back().merge(p)) {
+        toProvide2_.push_back(p);
+      }
+    }
+    toProvide_.swap(toProvide2_);
+    if (unlikely(isVerbose())) {
+      vlog("compact() was ", was, " now ", toProvide_.size());
+      for (auto const& t : toProvide_) {
+        vlog("...", t.start, " count=", t.count);
+      }
+    }
+  }
+
+  void returnIndex(uint16_t i) {
+    if (useBitmap_) {
+      free_.set(i - firstBid_);
+      ++toProvideCount_;
+      return;
+    }
+    if (toProvide_.empty()) {
+      toProvide_.emplace_back(i);
+    } else if (toProvide_.back().merge(i)) {
+      // yay, nothing to do
+    } else if (
+        toProvide_.size() >= 2 && toProvide_[toProvide_.size() - 2].merge(i)) {
+      // yay too, try merge these two. this accounts for out of order by 1 index
+      // where we receive 1,3,2. so we merge 2 into 3, and then (2,3) into 1
+      if (toProvide_[toProvide_.size() - 2].merge(toProvide_.back())) {
+        toProvide_.pop_back();
+      }
+    } else {
+      toProvide_.emplace_back(i);
+    }
+    ++toProvideCount_;
+  }
+
+  void provide(struct io_uring_sqe* sqe) {
+    if (useBitmap_) {
+      auto const [start, n] = free_.take();
+      io_uring_prep_provide_buffers(
+          sqe, buffers_[start], sizePerBuffer_, n, bgid_, firstBid_ + start);
+      sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;
+      toProvideCount_ -= n;
+      return;
+    }
+    Range const& r = toProvide_.back();
+    io_uring_prep_provide_buffers(
+        sqe,
+        buffers_[r.start - firstBid_],
+        sizePerBuffer_,
+        r.count,
+        bgid_,
+        r.start);
+    sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;
+    toProvideCount_ -= r.count;
+    toProvide_.pop_back();
+    assert(toProvide_.size() != 0 || toProvideCount_ == 0);
+  }
+
+  char const* getData(uint16_t i) const {
+    return buffers_[i - firstBid_];
+  }
+
+ private:
+  static constexpr int kAlignment = 32;
+
+  size_t addAlignment(size_t n) {
+    return kAlignment * ((n + kAlignment - 1) / kAlignment);
+  }
+
+  struct Range {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    explicit Range(uint16_t idx, uint16_t count = 1)
+        : count(count), start(idx) {}
+#else
+    explicit Range(uint16_t idx, uint16_t count = 1)
+        : start(idx), count(count) {}
+#endif
+    union {
+      struct {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        uint16_t count;
+        uint16_t start;
+#else
+        uint16_t start;
+        uint16_t count;
+#endif
+      };
+      uint32_t sortable; // big endian might need to swap these around
+    };
+
+    bool merge(uint16_t idx) {
+      if (idx == start - 1) {
+        start = idx;
+        count++;
+        return true;
+      } else if (idx == start + count) {
+        count++;
+        return true;
+      } else {
+        return false;
+      }
+    }
+
+    bool merge(Range const& r) {
+      if (start + count == r.start) {
+        count += r.count;
+        return true;
+      } else if (r.start + r.count == start) {
+        count += r.count;
+        start = r.start;
+        return true;
+      } else {
+        return false;
+      }
+    }
+  };
+
+  int bgid_;
+  uint16_t firstBid_;
+  size_t sizePerBuffer_;
+  Buffer buffer_;
+  std::vector<char*> buffers_;
+  ssize_t toProvideCount_ = 0;
+  int lowWatermark_;
+  std::vector<Range> toProvide_;
+  std::vector<Range> toProvide2_;
+  // returned buffers, instead of toProvide_, with provided_buffer_bitmap
+  bool useBitmap_;
+  FreeBitmap free_;
+};
+
+class BufferProviderV2 : private boost::noncopyable {
+ private:
+ public:
+  static constexpr int kBgid = 1;
+  static constexpr size_t kBufferAlignMask = 31LLU;
+
+  explicit BufferProviderV2(IoUringRxConfig const& rx_cfg)
+      : BufferProviderV2(rx_cfg, BufferGroupLayout::single(rx_cfg, kBgid)) {}
+
+  BufferProviderV2(IoUringRxConfig const& rx_cfg, BufferGroupLayout const& l)
+      : bgid_(l.bgid),
+        firstBid_(l.first_bid),
+        count_(l.count),
+        sizePerBuffer_(addAlignment(l.size)),
+        kernelRing_(rx_cfg.pbuf_ring_mmap) {
+    ringSize_ = 1;
+    ringMask_ = 0;
+    while (ringSize_ < count_) {
+      ringSize_ *= 2;
+    }
+    ringMask_ = io_uring_buf_ring_mask(ringSize_);
+
+    char* buffer_base;
+
+    ringMemSize_ = ringSize_ * sizeof(struct io_uring_buf);
+    ringMemSize_ = (ringMemSize_ + kBufferAlignMask) & (~kBufferAlignMask);
+    // the kernel allocates its own ring, mapped in at registration
+    size_t const user_ring = kernelRing_ ? 0 : ringMemSize_;
+
+    // the ring has to be page aligned
+    BufferOptions opts = rx_cfg.buffers;
+    opts.mmap = true;
+    buffer_ = Buffer(count_ * sizePerBuffer_ + user_ring, opts);
+    vlog("buffer size=", buffer_.size(), " ring size=", ringMemSize_);
+    buffer_base = buffer_.data() + user_ring;
+    ring_ = kernelRing_ ? nullptr : (struct io_uring_buf_ring*)buffer_.data();
+    for (size_t i = 0; i < count_; i++) {
+      buffers_.push_back(buffer_base + i * sizePerBuffer_);
+    }
+
+    if (firstBid_ + count_ >= std::numeric_limits<uint16_t>::max()) {
+      die("buffer count too large: ", count_);
+    }
+    reset();
+
+    vlog(
+        "ring address=",
+        ring_,
+        " ring size=",
+        ringSize_,
+        " buffer count=",
+        count_,
+        " ring_mask=",
+        ringMask_,
+        " tail now ",
+        tailCached_);
+  }
+
+  ~BufferProviderV2() {
+    unmapKernelRing();
+  }
+
+  size_t count() const {
+    return count_;
+  }
+
+  int bgid() const {
+    return bgid_;
+  }
+
+  uint16_t firstBid() const {
+    return firstBid_;
+  }
+
+  size_t sizePerBuffer() const {
+    return sizePerBuffer_;
+  }
+
+  size_t toProvideCount() const {
+    return cachedIndices;
+  }
+
+  // fill the ring with every buffer, only valid once all have come back. a
+  // kernel allocated ring is filled once it is registered
+  void reset() {
+    if (!ring_) {
+      return;
+    }
+    io_uring_buf_ring_init(ring_);
+    for (uint16_t i = 0; i < count_; i++) {
+      ring_->bufs[i] = {};
+      populate(ring_->bufs[i], firstBid_ + i);
+    }
+    cachedIndices = 0;
+    tailCached_ = count_;
+    io_uring_smp_store_release(&ring_->tail, tailCached_);
+  }
+
+  template <class GetSqe>
+  void unregister(struct io_uring* ring, GetSqe&&) {
+    checkedErrno(
+        io_uring_unregister_buf_ring(ring, bgid_), "unregister pbuf");
+    cachedIndices = 0;
+    unmapKernelRing();
+  }
+
+  // the ring lives in the same memory, so reset() before registering again
+  void discard() {
+    buffer_.discard();
+  }
+
+  bool canProvide() const {
+    return false;
+  }
+
+  bool needsToProvide() const {
+    return false;
+  }
+
+  void compact() {}
+
+  inline void populate(struct io_uring_buf& b, uint16_t i) {
+    b.bid = i;
+    b.addr = (__u64)getData(i);
+
+    // can we assume kernel doesnt touch len or resv?
+    b.len = sizePerBuffer_;
+    // b.resv = 0;
+  }
+
+  void returnIndex(uint16_t i) {
+    indices[cachedIndices++] = i;
+    if (likely(cachedIndices < indices.size())) {
+      return;
+    }
+    cachedIndices = 0;
+    for (uint16_t idx : indices) {
+      populate(ring_->bufs[(tailCached_ & ringMask_)], idx);
+      ++tailCached_;
+    }
+
+    io_uring_smp_store_release(&ring_->tail, tailCached_);
+  }
+
+  void provide(struct io_uring_sqe*) {}
+
+  char const* getData(uint16_t i) const {
+    return buffers_[i - firstBid_];
+  }
+
+  void initialRegister(struct io_uring* ring) {
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_entries = ringSize_;
+    reg.bgid = bgid_;
+    if (!kernelRing_) {
+      reg.ring_addr = (__u64)ring_;
+      checkedErrno(io_uring_register_buf_ring(ring, &reg, 0), "register pbuf");
+      return;
+    }
+    // flags follow bgid, where older headers only have padding
+    uint16_t const flags = IOU_PBUF_RING_MMAP;
+    memcpy(
+        (char*)&reg + offsetof(struct io_uring_buf_reg, bgid) + sizeof(reg.bgid),
+        &flags,
+        sizeof(flags));
+    checkedErrno(
+        io_uring_register_buf_ring(ring, &reg, 0),
+        "register pbuf with IOU_PBUF_RING_MMAP");
+    off_t const off =
+        IORING_OFF_PBUF_RING | ((uint64_t)bgid_ << IORING_OFF_PBUF_SHIFT);
+    void* p = mmap(
+        NULL,
+        ringMemSize_,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE,
+        ring->ring_fd,
+        off);
+    if (p == MAP_FAILED) {
+      auto errnoCopy = errno;
+      die("unable to map kernel pbuf ring: ", strerror(errnoCopy));
+    }
+    ring_ = (struct io_uring_buf_ring*)p;
+    reset();
+  }
+
+ private:
+  void unmapKernelRing() {
+    if (kernelRing_ && ring_) {
+      munmap(ring_, ringMemSize_);
+      ring_ = nullptr;
+    }
+  }
+
+  static constexpr int kAlignment = 32;
+
+  size_t addAlignment(size_t n) {
+    return kAlignment * ((n + kAlignment - 1) / kAlignment);
+  }
+
+  int bgid_;
+  uint16_t firstBid_;
+  size_t count_;
+  size_t sizePerBuffer_;
+  Buffer buffer_;
+  std::vector<char*> buffers_;
+  uint16_t tailCached_ = 0;
+  size_t ringMemSize_;
+  uint32_t ringSize_;
+  uint32_t ringMask_;
+  uint32_t cachedIndices = 0;
+  // IOU_PBUF_RING_MMAP: ring_ is the kernel's, mapped at registration
+  bool kernelRing_;
+  struct io_uring_buf_ring* ring_;
+  std::array<uint16_t, 32> indices;
+};
+
+// provided buffers split into groups, each with its own range of buffer ids
+// so that a completion's id alone finds the data. there is a size class per
+// entry in provided_buffer_sizes (or just recv_size), and reads pick the
+// class for the bytes they expect. only the first group of each class is
+// registered up front. more are registered when the kernel runs out (ENOBUFS)
+// up to provided_buffer_max_groups per class, and retired again once the
+// class has been quiet for provided_buffer_shrink_ms
+template <class TProvider>
+class BufferPool : private boost::noncopyable {
+ public:
+  explicit BufferPool(IoUringRxConfig const& rx_cfg)
+      : cfg_(rx_cfg),
+        shrinkAfter_(rx_cfg.provided_buffer_shrink_ms),
+        start_(std::chrono::steady_clock::now()) {
+    auto sizes = rx_cfg.provided_buffer_classes;
+    if (sizes.empty()) {
+      sizes.emplace_back(rx_cfg.recv_size, rx_cfg.provided_buffer_count);
+    }
+    size_t const per_class = std::max(1, rx_cfg.provided_buffer_max_groups);
+    size_t bid = 0;
+    for (auto const& [size, count] : sizes) {
+      Class& c = classes_.emplace_back();
+      c.size = size;
+      c.count = count;
+      c.firstGroup = groups_.size();
+      c.groups = per_class;
+      c.lastPressure = start_;
+      for (size_t i = 0; i < per_class; i++) {
+        Group& g = groups_.emplace_back();
+        g.cls = classes_.size() - 1;
+        g.firstBid = bid;
+        bid += count;
+      }
+    }
+    if (groups_.size() > std::numeric_limits<uint8_t>::max()) {
+      die("too many provided buffer groups: ", groups_.size());
+    }
+    if (bid >= std::numeric_limits<uint16_t>::max()) {
+      die("provided buffers (times provided_buffer_max_groups) must fit in "
+          "16 bit buffer ids, have ",
+          bid);
+    }
+    bidGroup_.resize(bid);
+    for (size_t i = 0; i < groups_.size(); i++) {
+      auto const first = bidGroup_.begin() + groups_[i].firstBid;
+      std::fill(first, first + classes_[groups_[i].cls].count, i);
+    }
+  }
+
+  // one past the largest buffer id that might be used
+  size_t bidLimit() const {
+    return bidGroup_.size();
+  }
+
+  void initialRegister(struct io_uring* ring) {
+    for (auto& c : classes_) {
+      activate(ring, c.firstGroup);
+    }
+  }
+
+  // the group for a read expecting this many bytes (0 if not known). the
+  // smallest class that fits is used if it has buffers, then bigger ones,
+  // then smaller. within a class lower groups are filled first so that the
+  // higher ones drain and can be retired
+  TProvider& pick(size_t expected) {
+    size_t c = 0;
+    while (c + 1 < classes_.size() && classes_[c].size < expected) {
+      c++;
+    }
+    for (size_t i = c; i < classes_.size(); i++) {
+      if (auto* p = pickIn(classes_[i])) {
+        return *p;
+      }
+    }
+    for (size_t i = c; i-- > 0;) {
+      if (auto* p = pickIn(classes_[i])) {
+        return *p;
+      }
+    }
+    // nothing left, this read will just get ENOBUFS
+    return *groups_[classes_[c].firstGroup].provider;
+  }
+
+  // buffers the kernel can hand out right now
+  size_t available() const {
+    size_t ret = 0;
+    for (auto const& g : groups_) {
+      ret += g.active ? available(g) : 0;
+    }
+    return ret;
+  }
+
+  char const* getData(uint16_t i) const {
+    return group(i).provider->getData(i);
+  }
+
+  // a completion handed us buffer i holding bytes of data
+  void took(uint16_t i, size_t bytes) {
+    Group& g = group(i);
+    ++g.inUse;
+    Class& c = classes_[g.cls];
+    ++c.cqes;
+    c.bytes += bytes;
+  }
+
+  void returnIndex(uint16_t i) {
+    Group& g = group(i);
+    --g.inUse;
+    if (likely(g.active)) {
+      g.provider->returnIndex(i);
+    } else if (!g.inUse) {
+      g.provider->discard();
+    }
+  }
+
+  size_t toProvideCount() const {
+    size_t ret = 0;
+    for (auto const& g : groups_) {
+      ret += g.active ? g.provider->toProvideCount() : 0;
+    }
+    return ret;
+  }
+
+  bool needsToProvide() const {
+    return std::any_of(groups_.begin(), groups_.end(), [](auto const& g) {
+      return g.active && g.provider->needsToProvide();
+    });
+  }
+
+  bool canProvide() const {
+    return std::any_of(groups_.begin(), groups_.end(), [](auto const& g) {
+      return g.active && g.provider->canProvide();
+    });
+  }
+
+  void compact() {
+    for (auto& g : groups_) {
+      if (g.active) {
+        g.provider->compact();
+      }
+    }
+  }
+
+  void provide(struct io_uring_sqe* sqe) {
+    for (auto& g : groups_) {
+      if (g.active && g.provider->canProvide()) {
+        g.provider->provide(sqe);
+        return;
+      }
+    }
+  }
+
+  // a read on group bgid ran out. returns true if another group was
+  // registered for its class
+  bool exhausted(struct io_uring* ring, int bgid) {
+    ++exhaustedCount_;
+    Class& c = classes_[groups_[bgid - TProvider::kBgid].cls];
+    c.lastPressure = std::chrono::steady_clock::now();
+    for (size_t i = c.firstGroup; i < c.firstGroup + c.groups; i++) {
+      // retired groups can only come back once all their buffers have
+      if (!groups_[i].active && !groups_[i].inUse) {
+        activate(ring, i);
+        ++grows_;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // retire the highest group of a class if nothing in it has run out for a
+  // while, and what is in use would comfortably fit in the rest
+  template <class GetSqe>
+  void maybeShrink(struct io_uring* ring, GetSqe&& get_sqe) {
+    if (activeGroups_ <= classes_.size()) {
+      return;
+    }
+    auto const now = std::chrono::steady_clock::now();
+    for (auto& c : classes_) {
+      if (c.active <= 1 || now - c.lastPressure < shrinkAfter_) {
+        continue;
+      }
+      c.lastPressure = now;
+      size_t in_use = 0;
+      for (size_t i = c.firstGroup; i < c.firstGroup + c.groups; i++) {
+        in_use += groups_[i].inUse;
+      }
+      if (in_use * 2 > (c.active - 1) * c.count) {
+        continue;
+      }
+      for (size_t i = c.firstGroup + c.groups - 1; i > c.firstGroup; i--) {
+        Group& g = groups_[i];
+        if (!g.active) {
+          continue;
+        }
+        // any reads still armed on this group will get ENOBUFS and move on.
+        // buffers out already stay valid until they come back
+        g.provider->unregister(ring, get_sqe);
+        g.active = false;
+        --c.active;
+        --activeGroups_;
+        if (!g.inUse) {
+          g.provider->discard();
+        }
+        ++shrinks_;
+        record();
+        break;
+      }
+    }
+  }
+
+  std::string toString() const {
+    std::string history;
+    for (auto const& [at, kb] : history_) {
+      history += strcat(history.empty() ? "" : " ", at, "s:", kb, "kB");
+    }
+    std::string classes;
+    if (classes_.size() > 1) {
+      for (auto const& c : classes_) {
+        double const mb = c.bytes / 1000000.0;
+        classes += strcat(
+            " class[",
+            c.size,
+            "]={peak_kB=",
+            c.peakKb,
+            " MB=",
+            mb,
+            " cqesPerMB=",
+            mb > 0 ? c.cqes / mb : 0.0,
+            "}");
+      }
+    }
+    return strcat(
+        " exhausted=",
+        exhaustedCount_,
+        " grows=",
+        grows_,
+        " shrinks=",
+        shrinks_,
+        classes,
+        " memory=[",
+        history,
+        "]");
+  }
+
+ private:
+  struct Class {
+    size_t size;
+    // buffers per group
+    size_t count;
+    size_t firstGroup;
+    size_t groups;
+    size_t active = 0;
+    std::chrono::steady_clock::time_point lastPressure;
+    // reads that landed in this class, and their bytes
+    size_t cqes = 0;
+    size_t bytes = 0;
+    size_t peakKb = 0;
+  };
+
+  struct Group {
+    std::unique_ptr<TProvider> provider;
+    size_t cls;
+    uint16_t firstBid;
+    bool active = false;
+    // handed out by the kernel and not yet returned
+    size_t inUse = 0;
+  };
+
+  Group& group(uint16_t i) {
+    return groups_[bidGroup_[i]];
+  }
+
+  Group const& group(uint16_t i) const {
+    return groups_[bidGroup_[i]];
+  }
+
+  TProvider* pickIn(Class const& c) {
+    for (size_t i = c.firstGroup; i < c.firstGroup + c.groups; i++) {
+      if (groups_[i].active && available(groups_[i]) > 0) {
+        return groups_[i].provider.get();
+      }
+    }
+    return nullptr;
+  }
+
+  size_t available(Group const& g) const {
+    size_t const count = classes_[g.cls].count;
+    size_t const out = g.inUse + g.provider->toProvideCount();
+    return out < count ? count - out : 0;
+  }
+
+  void activate(struct io_uring* ring, size_t idx) {
+    Group& g = groups_[idx];
+    Class& c = classes_[g.cls];
+    if (!g.provider) {
+      g.provider = std::make_unique<TProvider>(
+          cfg_,
+          BufferGroupLayout{
+              (int)(TProvider::kBgid + idx), g.firstBid, c.size, c.count});
+    } else {
+      g.provider->reset();
+    }
+    g.provider->initialRegister(ring);
+    g.active = true;
+    ++c.active;
+    c.peakKb = std::max(c.peakKb, c.active * c.count * c.size / 1024);
+    ++activeGroups_;
+    record();
+  }
+
+  void record() {
+    std::chrono::duration<double> const at =
+        std::chrono::steady_clock::now() - start_;
+    size_t kb = 0;
+    for (auto const& c : classes_) {
+      kb += c.active * c.count * c.size / 1024;
+    }
+    history_.emplace_back(std::round(at.count() * 10) / 10, kb);
+  }
+
+  IoUringRxConfig const cfg_;
+  std::chrono::milliseconds const shrinkAfter_;
+  std::chrono::steady_clock::time_point const start_;
+  std::vector<Class> classes_;
+  std::vector<Group> groups_;
+  // buffer id -> index into groups_
+  std::vector<uint8_t> bidGroup_;
+  size_t activeGroups_ = 0;
+  size_t exhaustedCount_ = 0;
+  size_t grows_ = 0;
+  size_t shrinks_ = 0;
+  // (seconds since start, buffer memory registered) at each change
+  std::vector<std::pair<double, size_t>> history_;
+};
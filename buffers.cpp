@@ -0,0 +1,115 @@
+#include "buffers.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <utility>
+
+#include "util.h"
+
+std::string BufferOptions::toString() const {
+  return strcat(
+      huge_pages ? " huge_pages=1" : "",
+      thp ? " thp=1" : "",
+      prefault ? " prefault=1" : "",
+      mlock ? " mlock=1" : "");
+}
+
+Buffer::Buffer(size_t size, BufferOptions const& opts)
+    : opts_(opts), size_(size) {
+  if (!size) {
+    return;
+  }
+  if (!opts.any()) {
+    size_t const rounded = (size + kAlignment - 1) & ~(kAlignment - 1);
+    data_ = (char*)aligned_alloc(kAlignment, rounded);
+    if (!data_) {
+      die("unable to allocate ", size, " bytes");
+    }
+    memset(data_, 0, size);
+    return;
+  }
+
+  size_t const page = opts.huge_pages ? kHugePageSize : getpagesize();
+  mapped_ = (size + page - 1) & ~(page - 1);
+  int flags = MAP_ANONYMOUS | MAP_PRIVATE;
+  if (opts.huge_pages) {
+    flags |= MAP_HUGETLB;
+    reserveHugePages(mapped_ / kHugePageSize);
+  }
+  void* p = mmap(NULL, mapped_, PROT_READ | PROT_WRITE, flags, -1, 0);
+  if (p == MAP_FAILED) {
+    auto errnoCopy = errno;
+    die("unable to map ", mapped_, " bytes", opts.toString(), ": ",
+        strerror(errnoCopy));
+  }
+  data_ = (char*)p;
+  if (opts.thp && !opts.huge_pages &&
+      madvise(data_, mapped_, MADV_HUGEPAGE) < 0) {
+    log("madvise(MADV_HUGEPAGE) failed: ", strerror(errno));
+  }
+  if (opts.prefault) {
+    // write rather than read, reads would all map the zero page
+    for (size_t i = 0; i < mapped_; i += getpagesize()) {
+      data_[i] = 0;
+    }
+  }
+  if (opts.mlock && ::mlock(data_, mapped_) < 0) {
+    log("mlock of ", mapped_, " bytes failed: ", strerror(errno),
+        " (check ulimit -l)");
+  }
+  vlog("mapped buffer size=", size, " mapped=", mapped_, opts.toString());
+}
+
+Buffer::Buffer(Buffer&& o) noexcept {
+  *this = std::move(o);
+}
+
+Buffer& Buffer::operator=(Buffer&& o) noexcept {
+  std::swap(opts_, o.opts_);
+  std::swap(data_, o.data_);
+  std::swap(size_, o.size_);
+  std::swap(mapped_, o.mapped_);
+  return *this;
+}
+
+Buffer::~Buffer() {
+  release();
+}
+
+void Buffer::release() {
+  if (!data_) {
+    return;
+  }
+  if (mapped_) {
+    munmap(data_, mapped_);
+    if (opts_.huge_pages) {
+      releaseHugePages(mapped_ / kHugePageSize);
+    }
+  } else {
+    free(data_);
+  }
+  data_ = nullptr;
+  size_ = mapped_ = 0;
+}
+
+void Buffer::discard() {
+  if (mapped_ && madvise(data_, mapped_, MADV_DONTNEED) < 0) {
+    // eg mlocked memory
+    vlog("madvise(MADV_DONTNEED) failed: ", strerror(errno));
+  }
+}
+
+void Buffer::resize(size_t size) {
+  if (size == size_) {
+    return;
+  }
+  Buffer b(size, opts_);
+  if (data_) {
+    memcpy(b.data(), data_, std::min(size, size_));
+  }
+  *this = std::move(b);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include <boost/core/noncopyable.hpp>
+
+// how a Buffer gets its memory. with nothing set it is a plain heap
+// allocation, as it always was
+struct BufferOptions {
+  // MAP_HUGETLB 2MB pages, reserved through /proc/sys/vm/nr_hugepages
+  bool huge_pages = false;
+  // madvise(MADV_HUGEPAGE) for transparent huge pages
+  bool thp = false;
+  // touch every page up front, so faults are not part of the measurement
+  bool prefault = false;
+  // mlock the memory, which also faults it in
+  bool mlock = false;
+  // always use an anonymous mapping, for memory that must be page aligned
+  bool mmap = false;
+
+  bool any() const {
+    return huge_pages || thp || prefault || mlock || mmap;
+  }
+  std::string toString() const;
+};
+
+// a hot buffer (receive, send or provided buffers). aligned to at least
+// kAlignment, and to the page size if any option is set
+class Buffer : private boost::noncopyable {
+ public:
+  static constexpr size_t kAlignment = 32;
+  static constexpr size_t kHugePageSize = 1LLU << 21;
+
+  Buffer() = default;
+  Buffer(size_t size, BufferOptions const& opts);
+  Buffer(Buffer&& o) noexcept;
+  Buffer& operator=(Buffer&& o) noexcept;
+  ~Buffer();
+
+  char* data() const {
+    return data_;
+  }
+  size_t size() const {
+    return size_;
+  }
+
+  // grows or shrinks, keeping the contents that fit
+  void resize(size_t size);
+
+  // hand the pages back to the kernel but keep the mapping, so the memory
+  // reads as zeros (and faults back in) if used again. no-op if not mapped
+  void discard();
+
+ private:
+  void release();
+
+  BufferOptions opts_;
+  char* data_ = nullptr;
+  size_t size_ = 0;
+  // non zero if data_ came from mmap
+  size_t mapped_ = 0;
+};
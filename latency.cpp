@@ -0,0 +1,136 @@
+#include "latency.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "util.h"
+
+LatencyResult LatencyResult::from(
+    std::vector<std::chrono::microseconds>&& durations) {
+  LatencyResult ret;
+  if (durations.size() == 0) {
+    return ret;
+  }
+  std::sort(durations.begin(), durations.end());
+  size_t const count = durations.size();
+  ret.count = count;
+  ret.p100 = durations.back();
+  ret.p999 = durations[(size_t)(durations.size() * 0.999)];
+  ret.p99 = durations[(size_t)(durations.size() * 0.99)];
+  ret.p95 = durations[(int)(durations.size() * 0.95)];
+  ret.p50 = durations[durations.size() / 2];
+  ret.avg =
+      std::accumulate(
+          durations.begin(), durations.end(), std::chrono::microseconds(0)) /
+      durations.size();
+  return ret;
+}
+
+LatencyResult LatencyResult::fromKeepingSamples(
+    std::vector<std::chrono::microseconds>&& durations) {
+  LatencyResult ret = from(std::move(durations));
+  ret.samples = std::move(durations);
+  return ret;
+}
+
+void LatencyResult::mergeIn(LatencyResult&& l) {
+  if (count <= 0) {
+    *this = std::move(l);
+    return;
+  }
+  if (l.count <= 0) {
+    return;
+  }
+  if (!samples.empty() && !l.samples.empty()) {
+    std::vector<std::chrono::microseconds> all(
+        samples.size() + l.samples.size());
+    std::merge(
+        samples.begin(),
+        samples.end(),
+        l.samples.begin(),
+        l.samples.end(),
+        all.begin());
+    *this = fromKeepingSamples(std::move(all));
+    return;
+  }
+  // percentiles can not be averaged, so this only estimates them
+  double const new_count = count + l.count;
+  samples.clear();
+  auto upd = [&](std::chrono::microseconds& self,
+                 std::chrono::microseconds const& other) {
+    // todo rounding maybe?
+    int64_t us =
+        (self.count() * this->count + other.count() * l.count) / new_count;
+    self = std::chrono::microseconds{us};
+  };
+  upd(p100, l.p100);
+  upd(p999, l.p999);
+  upd(p99, l.p99);
+  upd(p95, l.p95);
+  upd(p50, l.p50);
+  upd(avg, l.avg);
+  count = new_count;
+}
+
+LatencyResult LatencyResult::avgMerge(std::vector<LatencyResult> const& bs) {
+  LatencyResult ret;
+  if (bs.empty()) {
+    return ret;
+  }
+  for (auto& b : bs) {
+    ret.p100 += b.p100;
+    ret.p999 += b.p999;
+    ret.p99 += b.p99;
+    ret.p95 += b.p95;
+    ret.p50 += b.p50;
+    ret.avg += b.avg;
+    ret.count += b.count;
+  }
+  ret.p100 /= bs.size();
+  ret.p999 /= bs.size();
+  ret.p99 /= bs.size();
+  ret.p95 /= bs.size();
+  ret.p50 /= bs.size();
+  ret.avg /= bs.size();
+  ret.count /= (double)bs.size();
+  return ret;
+}
+
+std::string LatencyResult::toString() const {
+  return strcat(
+      "p999=",
+      p999.count(),
+      "us",
+      " p99=",
+      p99.count(),
+      "us",
+      " p95=",
+      p95.count(),
+      "us",
+      " p50=",
+      p50.count(),
+      "us",
+      " avg=",
+      avg.count(),
+      "us",
+      " p100=",
+      p100.count(),
+      "us count=",
+      count);
+}
+
+std::vector<std::chrono::microseconds> correctCoordinatedOmission(
+    std::vector<std::chrono::microseconds> const& raw,
+    std::chrono::microseconds interval) {
+  std::vector<std::chrono::microseconds> ret = raw;
+  if (interval.count() <= 0) {
+    return ret;
+  }
+  for (auto const& d : raw) {
+    for (auto missing = d - interval; missing >= interval;
+         missing -= interval) {
+      ret.push_back(missing);
+    }
+  }
+  return ret;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+struct LatencyResult {
+  std::chrono::microseconds p100 = {};
+  std::chrono::microseconds p999 = {};
+  std::chrono::microseconds p99 = {};
+  std::chrono::microseconds p95 = {};
+  std::chrono::microseconds p50 = {};
+  std::chrono::microseconds avg = {};
+  double count = 0.0 /* avg count done per burst */;
+  // sorted durations, only kept by fromKeepingSamples
+  std::vector<std::chrono::microseconds> samples;
+
+  static LatencyResult from(std::vector<std::chrono::microseconds>&& durations);
+  // as from, but keeps the samples so that merging two of these gives the
+  // exact percentiles of all of them rather than an estimate
+  static LatencyResult fromKeepingSamples(
+      std::vector<std::chrono::microseconds>&& durations);
+  void mergeIn(LatencyResult&& l);
+  static LatencyResult avgMerge(std::vector<LatencyResult> const& bs);
+  std::string toString() const;
+};
+
+// a closed loop sender held up by a stall does not send the requests it
+// would have, so the stall is only seen once. adds back the samples those
+// requests would have had, as if one was due every interval (as
+// HdrHistogram's recordValueWithExpectedInterval does)
+std::vector<std::chrono::microseconds> correctCoordinatedOmission(
+    std::vector<std::chrono::microseconds> const& raw,
+    std::chrono::microseconds interval);
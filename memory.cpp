@@ -0,0 +1,205 @@
+#include "memory.h"
+
+#include <dirent.h>
+#include <linux/sock_diag.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "util.h"
+
+namespace {
+
+// SO_MEMINFO over every socket would take a while with a lot of
+// connections, and it is only an estimate anyway
+constexpr size_t kMaxMemInfoSockets = 256;
+
+// parse "Name:   123 kB" lines
+void readKbFields(
+    char const* path,
+    std::initializer_list<std::pair<char const*, uint64_t*>> fields) {
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    return;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), f)) {
+    for (auto const& [name, out] : fields) {
+      size_t const n = strlen(name);
+      if (strncmp(line, name, n) == 0 && line[n] == ':') {
+        unsigned long long v;
+        if (sscanf(line + n + 1, "%llu", &v) == 1) {
+          *out = v;
+        }
+      }
+    }
+  }
+  fclose(f);
+}
+
+uint64_t sockstatTcpKb() {
+  FILE* f = fopen("/proc/net/sockstat", "r");
+  if (!f) {
+    return 0;
+  }
+  char line[256];
+  uint64_t ret = 0;
+  while (fgets(line, sizeof(line), f)) {
+    if (strncmp(line, "TCP:", 4)) {
+      continue;
+    }
+    char const* mem = strstr(line, " mem ");
+    unsigned long long pages;
+    if (mem && sscanf(mem + 5, "%llu", &pages) == 1) {
+      ret = pages * (getpagesize() / 1024);
+    }
+  }
+  fclose(f);
+  return ret;
+}
+
+std::vector<int> socketFds() {
+  std::vector<int> ret;
+  DIR* d = opendir("/proc/self/fd");
+  if (!d) {
+    return ret;
+  }
+  int const self = dirfd(d);
+  while (struct dirent* e = readdir(d)) {
+    int fd = atoi(e->d_name);
+    if (e->d_name[0] == '.' || fd == self) {
+      continue;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISSOCK(st.st_mode)) {
+      ret.push_back(fd);
+    }
+  }
+  closedir(d);
+  return ret;
+}
+
+} // namespace
+
+MemoryStats MemoryStats::sample() {
+  MemoryStats s;
+  readKbFields(
+      "/proc/self/status",
+      {{"VmRSS", &s.rss},
+       {"VmHWM", &s.peak_rss},
+       {"RssAnon", &s.anon},
+       {"HugetlbPages", &s.hugetlb},
+       {"VmLck", &s.locked},
+       {"VmPin", &s.pinned}});
+  readKbFields("/proc/self/smaps_rollup", {{"AnonHugePages", &s.thp}});
+  s.sockstat_tcp = sockstatTcpKb();
+
+  // the fds belong to other threads, and might be closed (or even reused)
+  // under us. that only makes this a little less accurate
+  auto fds = socketFds();
+  s.sockets = fds.size();
+  size_t const step = std::max<size_t>(1, fds.size() / kMaxMemInfoSockets);
+  size_t sampled = 0;
+  uint64_t rmem = 0, wmem_queued = 0, fwd_alloc = 0;
+  for (size_t i = 0; i < fds.size(); i += step) {
+    uint32_t info[SK_MEMINFO_VARS];
+    socklen_t len = sizeof(info);
+    if (getsockopt(fds[i], SOL_SOCKET, SO_MEMINFO, info, &len) < 0) {
+      continue;
+    }
+    rmem += info[SK_MEMINFO_RMEM_ALLOC];
+    wmem_queued += info[SK_MEMINFO_WMEM_QUEUED];
+    fwd_alloc += info[SK_MEMINFO_FWD_ALLOC];
+    sampled++;
+  }
+  if (sampled) {
+    s.sock_rmem = rmem * s.sockets / sampled / 1024;
+    s.sock_wmem_queued = wmem_queued * s.sockets / sampled / 1024;
+    s.sock_fwd_alloc = fwd_alloc * s.sockets / sampled / 1024;
+  }
+  return s;
+}
+
+void MemoryStats::max(MemoryStats const& o) {
+  auto m = [](uint64_t& a, uint64_t b) { a = std::max(a, b); };
+  m(rss, o.rss);
+  m(peak_rss, o.peak_rss);
+  m(anon, o.anon);
+  m(hugetlb, o.hugetlb);
+  m(locked, o.locked);
+  m(pinned, o.pinned);
+  m(thp, o.thp);
+  m(sockstat_tcp, o.sockstat_tcp);
+  m(sock_rmem, o.sock_rmem);
+  m(sock_wmem_queued, o.sock_wmem_queued);
+  m(sock_fwd_alloc, o.sock_fwd_alloc);
+  m(sockets, o.sockets);
+}
+
+std::string MemoryReport::toString() const {
+  auto const& p = peak;
+  uint64_t const per = connections
+      ? connections
+      : (p.sockets > baseline.sockets ? p.sockets - baseline.sockets : 0);
+  char const* const unit = connections ? "kB/conn" : "kB/sock";
+  auto growth = [per](uint64_t now, uint64_t base) {
+    if (!per || now <= base) {
+      return 0.0;
+    }
+    return (now - base) / (double)per;
+  };
+  auto item = [&](char const* name, uint64_t now, uint64_t base) {
+    return strcat(" ", name, "=", now, "kB(", growth(now, base), unit, ")");
+  };
+  return strcat(
+      " memory={sockets=",
+      p.sockets,
+      item("rss", p.rss, baseline.rss),
+      " peak_rss=",
+      p.peak_rss,
+      "kB",
+      item("anon", p.anon, baseline.anon),
+      item("hugetlb", p.hugetlb, baseline.hugetlb),
+      item("thp", p.thp, baseline.thp),
+      item("locked", p.locked, baseline.locked),
+      item("pinned", p.pinned, baseline.pinned),
+      item("sockstat_tcp", p.sockstat_tcp, baseline.sockstat_tcp),
+      item("sock_rmem", p.sock_rmem, baseline.sock_rmem),
+      item("sock_wmem_queued", p.sock_wmem_queued, baseline.sock_wmem_queued),
+      item("sock_fwd_alloc", p.sock_fwd_alloc, baseline.sock_fwd_alloc),
+      "}");
+}
+
+MemoryMonitor::MemoryMonitor(std::chrono::milliseconds period)
+    : period_(period), baseline_(MemoryStats::sample()), peak_(baseline_) {
+  thread_ = std::thread(wrapThread("memory", [this]() {
+    std::unique_lock<std::mutex> g(mutex_);
+    while (!cv_.wait_for(g, period_, [this] { return done_; })) {
+      g.unlock();
+      auto s = MemoryStats::sample();
+      g.lock();
+      peak_.max(s);
+    }
+  }));
+}
+
+MemoryMonitor::~MemoryMonitor() {
+  finish();
+}
+
+MemoryReport MemoryMonitor::finish() {
+  {
+    std::lock_guard<std::mutex> g(mutex_);
+    done_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  return MemoryReport{baseline_, peak_};
+}
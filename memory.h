@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// memory used by the process and by its sockets in the kernel, all in kB
+struct MemoryStats {
+  // from /proc/self/status
+  uint64_t rss = 0;
+  uint64_t peak_rss = 0;
+  uint64_t anon = 0;
+  uint64_t hugetlb = 0;
+  // registered io_uring buffers and buffer rings show up here
+  uint64_t locked = 0;
+  uint64_t pinned = 0;
+  // from /proc/self/smaps_rollup
+  uint64_t thp = 0;
+  // tcp memory for the whole host, from /proc/net/sockstat
+  uint64_t sockstat_tcp = 0;
+  // SO_MEMINFO, sampled from some of the sockets and scaled up to all of them
+  uint64_t sock_rmem = 0;
+  uint64_t sock_wmem_queued = 0;
+  uint64_t sock_fwd_alloc = 0;
+  // sockets open in this process. both ends when running locally
+  uint64_t sockets = 0;
+
+  static MemoryStats sample();
+  void max(MemoryStats const& o);
+};
+
+struct MemoryReport {
+  // taken before the run started
+  MemoryStats baseline;
+  MemoryStats peak;
+  // connections the new sockets belong to, when known. a local run has both
+  // ends (and any proxy) in this process, so several sockets per connection
+  uint64_t connections = 0;
+
+  // peak usage, and growth over the baseline per connection when known, or
+  // else per new socket
+  std::string toString() const;
+};
+
+// samples MemoryStats in the background until finish(), keeping the peaks
+class MemoryMonitor {
+ public:
+  explicit MemoryMonitor(
+      std::chrono::milliseconds period = std::chrono::milliseconds(250));
+  ~MemoryMonitor();
+
+  MemoryReport finish();
+
+ private:
+  std::chrono::milliseconds const period_;
+  MemoryStats const baseline_;
+  MemoryStats peak_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool done_ = false;
+  std::thread thread_;
+};
@@ -0,0 +1,427 @@
+/*
+ * Microbenchmarks for the hot path data structures, without any sockets or
+ * rings involved so that changes to them can be measured without network
+ * noise. Built with `make microbench`, not part of netbench itself. Each
+ * reports ns per operation and heap allocations per operation.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+#include <liburing.h>
+
+#include "buffer_provider.h"
+#include "latency.h"
+#include "protocol.h"
+#include "rx_config.h"
+#include "rx_stats.h"
+#include "time_series.h"
+#include "util.h"
+
+namespace po = boost::program_options;
+
+// every allocation in the process, to report allocations per operation. the
+// deletes are noinline as otherwise gcc warns about free() on the result of
+// operator new once it can see both
+size_t gAllocations = 0;
+
+void* operator new(size_t n) {
+  ++gAllocations;
+  if (void* p = malloc(n ? n : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+  free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+namespace {
+
+struct BenchConfig {
+  std::string filter;
+  size_t provided_buffer_count = 8000;
+  size_t returns = 2000000;
+  size_t requests = 2000000;
+  size_t latency_samples = 10000000;
+  size_t loops = 20000000;
+  uint32_t seed = 1;
+};
+
+bool skip(BenchConfig const& bench, std::string const& name) {
+  return name.find(bench.filter) == std::string::npos;
+}
+
+// times and counts allocations in what it is given, which does ops
+// operations
+class Measure {
+ public:
+  template <class F>
+  void run(F&& f) {
+    size_t const allocs = gAllocations;
+    auto const start = std::chrono::steady_clock::now();
+    f();
+    timed_ += std::chrono::steady_clock::now() - start;
+    allocations_ += gAllocations - allocs;
+  }
+
+  std::string toString(size_t ops, char const* op = "op") const {
+    return strcat(
+        "  ns/",
+        op,
+        "=",
+        ops ? (double)timed_.count() / ops : 0.0,
+        " allocs/",
+        op,
+        "=",
+        ops ? (double)allocations_ / ops : 0.0);
+  }
+
+ private:
+  std::chrono::nanoseconds timed_{0};
+  size_t allocations_ = 0;
+};
+
+// the order buffers come back in, relative to the order the kernel used them
+enum class ReturnOrder { InOrder, AdjacentSwaps, Shuffled };
+
+char const* orderName(ReturnOrder o) {
+  switch (o) {
+    case ReturnOrder::InOrder:
+      return "in_order";
+    case ReturnOrder::AdjacentSwaps:
+      return "adjacent_swaps";
+    case ReturnOrder::Shuffled:
+      return "shuffled";
+  }
+  return "?";
+}
+
+void reorder(std::vector<uint16_t>& batch, ReturnOrder o, std::mt19937& rng) {
+  switch (o) {
+    case ReturnOrder::InOrder:
+      break;
+    case ReturnOrder::AdjacentSwaps:
+      for (size_t i = 0; i + 1 < batch.size(); i += 2) {
+        std::swap(batch[i], batch[i + 1]);
+      }
+      break;
+    case ReturnOrder::Shuffled:
+      std::shuffle(batch.begin(), batch.end(), rng);
+      break;
+  }
+}
+
+// drives BufferProviderV1 the way IOUringRunner does: buffers are handed out
+// in the order they were provided (as the kernel does), come back in batches
+// of batch_size in the given order, and get provided again whenever
+// needsToProvide() says so. only the provider calls are timed
+void benchProviderV1(
+    BenchConfig const& bench,
+    bool bitmap,
+    ReturnOrder order,
+    size_t batch_size) {
+  std::string const name = strcat(
+      "provider_v1 ",
+      bitmap ? "bitmap" : "ranges",
+      " ",
+      orderName(order),
+      " batch=",
+      batch_size);
+  if (skip(bench, name)) {
+    return;
+  }
+
+  IoUringRxConfig cfg;
+  cfg.recv_size = 64;
+  cfg.provided_buffer_count = bench.provided_buffer_count;
+  cfg.provided_buffer_low_watermark = bench.provided_buffer_count / 4;
+  cfg.provided_buffer_bitmap = bitmap;
+  BufferProviderV1 provider(cfg);
+
+  std::mt19937 rng(bench.seed);
+  std::deque<uint16_t> kernel;
+  std::vector<struct io_uring_sqe> sqes(bench.provided_buffer_count);
+  std::vector<uint16_t> batch;
+  batch.reserve(batch_size);
+  Measure measure;
+  size_t provide_calls = 0;
+  size_t provide_rounds = 0;
+
+  auto provide = [&]() {
+    size_t n = 0;
+    measure.run([&]() {
+      provider.compact();
+      while (provider.canProvide()) {
+        provider.provide(&sqes[n++]);
+      }
+    });
+    // the kernel hands these out first in, first out
+    for (size_t i = 0; i < n; i++) {
+      for (uint32_t j = 0; j < (uint32_t)sqes[i].fd; j++) {
+        kernel.push_back(sqes[i].off + j);
+      }
+    }
+    provide_calls += n;
+    ++provide_rounds;
+  };
+
+  provide();
+  provide_calls = provide_rounds = 0;
+  measure = {};
+
+  for (size_t done = 0; done < bench.returns; done += batch.size()) {
+    batch.clear();
+    while (batch.size() < batch_size && !kernel.empty()) {
+      batch.push_back(kernel.front());
+      kernel.pop_front();
+    }
+    reorder(batch, order, rng);
+
+    bool needs;
+    measure.run([&]() {
+      for (uint16_t i : batch) {
+        provider.returnIndex(i);
+      }
+      needs = provider.needsToProvide() || kernel.empty();
+    });
+    if (needs) {
+      provide();
+    }
+  }
+
+  log(leftpad(name, 50),
+      measure.toString(bench.returns, "buffer"),
+      " provide_sqes/round=",
+      provide_rounds ? (double)provide_calls / provide_rounds : 0.0);
+}
+
+// BufferProviderV2 only has to put returned buffers back in the ring (which
+// the kernel never consumes here, it just wraps)
+void benchProviderV2(
+    BenchConfig const& bench,
+    ReturnOrder order,
+    size_t batch_size) {
+  std::string const name =
+      strcat("provider_v2 ", orderName(order), " batch=", batch_size);
+  if (skip(bench, name)) {
+    return;
+  }
+
+  IoUringRxConfig cfg;
+  cfg.recv_size = 64;
+  cfg.provided_buffer_count = bench.provided_buffer_count;
+  BufferProviderV2 provider(cfg);
+
+  std::mt19937 rng(bench.seed);
+  std::vector<uint16_t> batch;
+  batch.reserve(batch_size);
+  uint16_t const first = provider.firstBid();
+  Measure measure;
+  size_t next = 0;
+  for (size_t done = 0; done < bench.returns; done += batch.size()) {
+    batch.clear();
+    while (batch.size() < batch_size) {
+      batch.push_back(first + next);
+      next = (next + 1) % provider.count();
+    }
+    reorder(batch, order, rng);
+    measure.run([&]() {
+      for (uint16_t i : batch) {
+        provider.returnIndex(i);
+      }
+    });
+  }
+  log(leftpad(name, 50), measure.toString(bench.returns, "buffer"));
+}
+
+// a stream of requests (the 8 byte header, then the payload) handed to the
+// parser in reads of the given sizes
+void benchProtocolParser(
+    BenchConfig const& bench,
+    uint32_t request_size,
+    char const* reads_name,
+    std::function<size_t(std::mt19937&)> read_size) {
+  std::string const name =
+      strcat("protocol_parser size=", request_size, " reads=", reads_name);
+  if (skip(bench, name)) {
+    return;
+  }
+
+  // enough requests to not all fit in cache, replayed until done
+  size_t const per_stream =
+      std::max<size_t>(1, (4 << 20) / (request_size + 8));
+  std::vector<char> stream(per_stream * (request_size + 8));
+  for (size_t i = 0; i < per_stream; i++) {
+    uint32_t header[2] = {request_size, 1};
+    memcpy(stream.data() + i * (request_size + 8), header, sizeof(header));
+  }
+  std::mt19937 rng(bench.seed);
+  std::vector<std::pair<size_t, size_t>> reads;
+  for (size_t at = 0; at < stream.size();) {
+    size_t const n = std::min(read_size(rng), stream.size() - at);
+    reads.emplace_back(at, n);
+    at += n;
+  }
+
+  ProtocolParser parser;
+  Measure measure;
+  size_t parsed = 0;
+  size_t consumes = 0;
+  while (parsed < bench.requests) {
+    measure.run([&]() {
+      for (auto const& r : reads) {
+        parsed += parser.consume(stream.data() + r.first, r.second).count;
+      }
+    });
+    consumes += reads.size();
+  }
+  log(leftpad(name, 50),
+      measure.toString(parsed, "request"),
+      " consumes/request=",
+      (double)consumes / parsed);
+}
+
+void benchLatencyFrom(BenchConfig const& bench) {
+  std::string const name =
+      strcat("latency_result from samples=", bench.latency_samples);
+  if (skip(bench, name)) {
+    return;
+  }
+  // long tailed, like real latencies
+  std::mt19937 rng(bench.seed);
+  std::lognormal_distribution<double> dist(4.0, 1.0);
+  std::vector<std::chrono::microseconds> samples(bench.latency_samples);
+  for (auto& s : samples) {
+    s = std::chrono::microseconds((int64_t)dist(rng));
+  }
+  Measure measure;
+  LatencyResult r;
+  measure.run([&]() { r = LatencyResult::from(std::move(samples)); });
+  log(leftpad(name, 50),
+      measure.toString(bench.latency_samples, "sample"),
+      " p99=",
+      r.p99.count(),
+      "us");
+}
+
+void benchLatencyMergeIn(BenchConfig const& bench) {
+  std::string const name = "latency_result merge_in";
+  if (skip(bench, name)) {
+    return;
+  }
+  std::vector<LatencyResult> results(1024);
+  std::mt19937 rng(bench.seed);
+  for (auto& r : results) {
+    r.p50 = std::chrono::microseconds(rng() % 100);
+    r.p99 = std::chrono::microseconds(rng() % 1000);
+    r.count = 1 + rng() % 1000;
+  }
+  Measure measure;
+  LatencyResult total;
+  size_t const ops = bench.loops / 4;
+  measure.run([&]() {
+    for (size_t i = 0; i < ops; i++) {
+      LatencyResult r = results[i % results.size()];
+      total.mergeIn(std::move(r));
+    }
+  });
+  log(leftpad(name, 50), measure.toString(ops));
+}
+
+// every receiver loop calls this, with a log line roughly every second
+void benchRxStats(BenchConfig const& bench, bool series) {
+  std::string const name = strcat("rx_stats done_loop series=", series);
+  if (skip(bench, name)) {
+    return;
+  }
+  std::string const stats_name = "bench";
+  TimeSeries time_series(
+      std::chrono::milliseconds(10), std::chrono::steady_clock::now());
+  RxStats stats(stats_name, true, series ? &time_series : nullptr);
+  Measure measure;
+  measure.run([&]() {
+    for (size_t i = 0; i < bench.loops; i++) {
+      stats.doneLoop(i * 64, i, 1 + (i & 7), (i & 1023) == 0);
+    }
+  });
+  log(leftpad(name, 50), measure.toString(bench.loops));
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  BenchConfig bench;
+  po::options_description desc;
+  // clang-format off
+desc.add_options()
+  ("help", "produce help message")
+  ("filter", po::value(&bench.filter),
+   "only run benchmarks with this in their name")
+  ("provided_buffer_count", po::value(&bench.provided_buffer_count)
+     ->default_value(bench.provided_buffer_count))
+  ("returns", po::value(&bench.returns)->default_value(bench.returns),
+   "buffers returned per provider benchmark")
+  ("requests", po::value(&bench.requests)->default_value(bench.requests),
+   "requests parsed per protocol_parser benchmark")
+  ("latency_samples", po::value(&bench.latency_samples)
+     ->default_value(bench.latency_samples))
+  ("loops", po::value(&bench.loops)->default_value(bench.loops),
+   "calls per rx_stats benchmark, a quarter of that for merge_in")
+  ("seed", po::value(&bench.seed)->default_value(bench.seed))
+  ;
+  // clang-format on
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+  if (vm.count("help")) {
+    std::cerr << desc << "\n";
+    exit(1);
+  }
+
+  for (bool bitmap : {false, true}) {
+    for (auto order :
+         {ReturnOrder::InOrder,
+          ReturnOrder::AdjacentSwaps,
+          ReturnOrder::Shuffled}) {
+      for (size_t batch : {32, 1024}) {
+        benchProviderV1(bench, bitmap, order, batch);
+      }
+    }
+  }
+  for (auto order : {ReturnOrder::InOrder, ReturnOrder::Shuffled}) {
+    for (size_t batch : {32, 1024}) {
+      benchProviderV2(bench, order, batch);
+    }
+  }
+  for (uint32_t size : {64, 4096}) {
+    benchProtocolParser(
+        bench, size, "64k", [](std::mt19937&) -> size_t { return 65536; });
+    benchProtocolParser(bench, size, "fragmented", [](std::mt19937& rng) {
+      return 1 + rng() % 64;
+    });
+  }
+  // headers split across every read
+  benchProtocolParser(
+      bench, 64, "3_bytes", [](std::mt19937&) -> size_t { return 3; });
+  benchLatencyFrom(bench);
+  benchLatencyMergeIn(bench);
+  for (bool series : {false, true}) {
+    benchRxStats(bench, series);
+  }
+  return 0;
+}
@@ -1,6 +1,7 @@
 #include <boost/algorithm/string/join.hpp>
 #include <boost/align/aligned_allocator.hpp>
 #include <boost/core/noncopyable.hpp>
+#include <deque>
 #include <numeric>
 #include <string_view>
 #include <thread>
@@ -9,18 +10,33 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <liburing.h>
+#include <linux/tcp.h>
 #include <unistd.h>
 
 #include <netinet/in.h>
+#include <poll.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <sys/epoll.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/times.h>
 
+#include "buffer_provider.h"
+#include "buffers.h"
 #include "control.h"
+#include "memory.h"
+#include "perf_counters.h"
+#include "rx_config.h"
+#include "protocol.h"
+#include "rx_events.h"
+#include "rx_stats.h"
 #include "sender.h"
 #include "socket.h"
+#include "time_series.h"
+#include "timestamping.h"
+#include "trace.h"
 #include "util.h"
 
 namespace po = boost::program_options;
@@ -71,111 +87,7 @@ void intHandler(int dummy) {
   globalShouldShutdown = true;
 }
 
-enum class RxEngine { IoUring, Epoll };
-struct RxConfig {
-  int backlog = 100000;
-  int max_events = 32;
-  int recv_size = 4096;
-  bool recvmsg = false;
-  size_t workload = 0;
-  std::string description;
-
-  std::string describe() const {
-    if (description.empty()) {
-      return toString();
-    }
-    return description;
-  }
-
-  virtual std::string const toString() const {
-    // only give the important options:
-    auto is_default = [this](auto RxConfig::*x) {
-      RxConfig base;
-      return this->*x == base.*x;
-    };
-    return strcat(
-        is_default(&RxConfig::recvmsg) ? "" : strcat(" recvmsg=", recvmsg),
-        is_default(&RxConfig::workload) ? "" : strcat(" workload=", workload));
-  }
-};
-
-struct IoUringRxConfig : RxConfig {
-  bool supports_nonblock_accept = false;
-  bool register_ring = true;
-  int provide_buffers = 2;
-  bool fixed_files = true;
-  int sqe_count = 64;
-  int cqe_count = 0;
-  int max_cqe_loop = 256 * 32;
-  int provided_buffer_count = 8000;
-  int fixed_file_count = 16000;
-  int provided_buffer_low_watermark = -1;
-  int provided_buffer_compact = 1;
-  bool huge_pages = false;
-  int multishot_recv = 1;
-  bool defer_taskrun = false;
-
-  // not for actual user updating, but dependent on the kernel:
-  unsigned int cqe_skip_success_flag = 0;
-
-  std::string const toString() const override {
-    // only give the important options:
-    auto is_default = [this](auto IoUringRxConfig::*x) {
-      IoUringRxConfig base;
-      return this->*x == base.*x;
-    };
-    return strcat(
-        RxConfig::toString(),
-        (!is_default(&IoUringRxConfig::fixed_files) ||
-         !is_default(&IoUringRxConfig::fixed_file_count))
-            ? strcat(
-                  " fixed_files=",
-                  fixed_files ? strcat("1 (count=", fixed_file_count, ")")
-                              : strcat("0"))
-            : "",
-        is_default(&IoUringRxConfig::provide_buffers)
-            ? ""
-            : strcat(" provide_buffers=", provide_buffers),
-        is_default(&IoUringRxConfig::provided_buffer_count)
-            ? ""
-            : strcat(" provided_buffer_count=", provided_buffer_count),
-        is_default(&IoUringRxConfig::sqe_count)
-            ? ""
-            : strcat(" sqe_count=", sqe_count),
-        is_default(&IoUringRxConfig::cqe_count)
-            ? ""
-            : strcat(" cqe_count=", cqe_count),
-        is_default(&IoUringRxConfig::max_cqe_loop)
-            ? ""
-            : strcat(" max_cqe_loop=", max_cqe_loop),
-        is_default(&IoUringRxConfig::huge_pages)
-            ? ""
-            : strcat(" huge_pages=", huge_pages),
-        is_default(&IoUringRxConfig::defer_taskrun)
-            ? ""
-            : strcat(" defer_taskrun=", defer_taskrun),
-        is_default(&IoUringRxConfig::multishot_recv)
-            ? ""
-            : strcat(" multishot_recv=", multishot_recv));
-  }
-};
-
-struct EpollRxConfig : RxConfig {
-  bool batch_send = false;
-
-  std::string const toString() const override {
-    // only give the important options:
-    auto is_default = [this](auto EpollRxConfig::*x) {
-      EpollRxConfig base;
-      return this->*x == base.*x;
-    };
-    return strcat(
-        RxConfig::toString(),
-        is_default(&EpollRxConfig::batch_send)
-            ? ""
-            : strcat(" batch_send=", batch_send));
-  }
-};
+enum class RxEngine { IoUring, Epoll, Proxy };
 
 struct Config {
   std::vector<uint16_t> use_port;
@@ -186,6 +98,7 @@ struct Config {
 
   bool print_rx_stats = true;
   bool print_read_stats = true;
+  std::string results_file;
   std::vector<std::string> tx;
   std::vector<std::string> rx;
 };
@@ -196,16 +109,31 @@ int mkServerSock(
     bool const isv6,
     int extra_flags) {
   int fd = checkedErrno(mkBoundSock(port, isv6, extra_flags));
+  if (rx_cfg.rcvbuf > 0) {
+    // set before listen so the window scale is negotiated to match
+    doSetSockOpt<int>(fd, SOL_SOCKET, SO_RCVBUF, rx_cfg.rcvbuf);
+  }
   checkedErrno(listen(fd, rx_cfg.backlog), "listen");
   vlog("made sock ", fd, " v6=", isv6, " port=", port);
   return fd;
 }
 
-std::pair<struct io_uring, IoUringRxConfig> mkIoUring(
+// liburing 2.5 added io_uring_queue_init_mem for IORING_SETUP_NO_MMAP
+#if defined(IO_URING_CHECK_VERSION)
+#if !IO_URING_CHECK_VERSION(2, 5)
+#define NETBENCH_HAVE_QUEUE_INIT_MEM 1
+#endif
+#endif
+
+// the ring, the config updated for what the kernel supports, and with no_mmap
+// the memory the SQ/CQ rings live in (which must outlive the ring)
+std::tuple<struct io_uring, IoUringRxConfig, Buffer> mkIoUring(
     IoUringRxConfig const& rx_cfg) {
   struct io_uring_params params;
   struct io_uring ring;
   memset(&params, 0, sizeof(params));
+  auto const started = std::chrono::steady_clock::now();
+  Buffer ring_mem;
 
   // default to Nx sqe_count as we are very happy to submit multiple sqe off one
   // cqe (eg send,read) and this can build up quickly
@@ -225,20 +153,50 @@ std::pair<struct io_uring, IoUringRxConfig> mkIoUring(
   }
 
   params.cq_entries = cqe_count;
-  int ret = io_uring_queue_init_params(rx_cfg.sqe_count, &ring, &params);
+  auto init = [&]() {
+    if (!rx_cfg.no_mmap) {
+      return io_uring_queue_init_params(rx_cfg.sqe_count, &ring, &params);
+    }
+#ifdef NETBENCH_HAVE_QUEUE_INIT_MEM
+    // rings bigger than a page have to be in one huge page. liburing sets
+    // IORING_SETUP_NO_MMAP itself
+    if (!ring_mem.size()) {
+      BufferOptions opts;
+      opts.huge_pages = true;
+      ring_mem = Buffer(Buffer::kHugePageSize, opts);
+    }
+    int r = io_uring_queue_init_mem(
+        rx_cfg.sqe_count, &ring, &params, ring_mem.data(), ring_mem.size());
+    return r < 0 ? r : 0;
+#else
+    die("no_mmap needs liburing 2.5 or newer");
+    return -EINVAL;
+#endif
+  };
+  int ret = init();
   if (ret < 0) {
     log("trying init again without COOP_TASKRUN or SUBMIT_ALL");
     params.flags = params.flags & (~newer_flags);
-    checkedErrno(
-        io_uring_queue_init_params(rx_cfg.sqe_count, &ring, &params),
-        "io_uring_queue_init_params");
+    checkedErrno(init(), "io_uring_queue_init_params");
   }
 
   auto ret_cfg = rx_cfg;
-  if (params.features & IORING_FEAT_CQE_SKIP) {
+  // a send limit needs to see every send complete
+  if ((params.features & IORING_FEAT_CQE_SKIP) &&
+      !rx_cfg.max_sends_in_flight) {
     ret_cfg.cqe_skip_success_flag = IOSQE_CQE_SKIP_SUCCESS;
   }
-  return std::make_pair(ring, std::move(ret_cfg));
+  auto const took = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - started);
+  if (rx_cfg.no_mmap || rx_cfg.pbuf_ring_mmap) {
+    log("io_uring setup took ",
+        took.count(),
+        "us",
+        rx_cfg.no_mmap ? " (rings in a user huge page)" : "");
+  } else {
+    vlog("io_uring setup took ", took.count(), "us");
+  }
+  return std::make_tuple(ring, std::move(ret_cfg), std::move(ring_mem));
 }
 
 void runWorkload(RxConfig const& cfg, uint32_t consumed) {
@@ -247,221 +205,59 @@ void runWorkload(RxConfig const& cfg, uint32_t consumed) {
   runWorkload(consumed, cfg.workload);
 }
 
-struct ConsumeResults {
-  size_t to_write = 0;
-  uint32_t count = 0;
-
-  ConsumeResults& operator+=(ConsumeResults const& rhs) {
-    to_write += rhs.to_write;
-    count += rhs.count;
-    return *this;
-  }
-};
-
-// benchmark protocol is <uint32_t length>:<payload of size length>
-// response is a single byte when it is received
-struct ProtocolParser {
-  // consume data and return number of new sends
-
-  ConsumeResults consume(char const* data, size_t n) {
-    ConsumeResults ret;
-    while (n > 0) {
-      so_far += n;
-      if (!is_reading[0]) {
-        if (likely(n >= sizeof(is_reading) && size_buff_have == 0)) {
-          size_buff_have = sizeof(is_reading);
-          memcpy(&is_reading, data, sizeof(is_reading));
-        } else {
-          uint32_t size_buff_add =
-              std::min<uint32_t>(n, sizeof(is_reading) - size_buff_have);
-          memcpy(size_buff + size_buff_have, data, size_buff_add);
-          size_buff_have += size_buff_add;
-          if (size_buff_have >= sizeof(is_reading)) {
-            memcpy(&is_reading, size_buff, sizeof(is_reading));
-          }
-        }
-      }
-      if (is_reading[0] && so_far >= is_reading[0] + sizeof(is_reading)) {
-        data += n;
-        n = so_far - (is_reading[0] + sizeof(is_reading));
-        ret.to_write += is_reading[1];
-        ret.count++;
-        so_far = size_buff_have = 0;
-        memset(&is_reading, 0, sizeof(is_reading));
-      } else {
-        break;
-      }
-    }
-    return ret;
-  }
-
-  uint32_t size_buff_have = 0;
-  std::array<uint32_t, 2> is_reading = {{0}};
-  char size_buff[sizeof(is_reading)];
-  uint32_t so_far = 0;
-};
-
-class RxStats {
+class RunnerBase {
  public:
-  RxStats(std::string const& name, bool countReads)
-      : name_(name), countReads_(countReads) {
-    auto const now = std::chrono::steady_clock::now();
-    started_ = lastStats_ = now;
-    lastClock_ = checkedErrno(times(&lastTimes_), "initial times");
-    if (countReads_) {
-      reads_.reserve(32000);
-    }
+  explicit RunnerBase(std::string const& name)
+      : name_(name), rxEventSource_(RxEventLog::get().source(name)) {}
+  std::string const& name() const {
+    return name_;
   }
+  virtual void start() {}
+  virtual void loop(std::atomic<bool>* should_shutdown) = 0;
+  virtual void stop() = 0;
+  virtual void addListenSock(int fd, bool v6) = 0;
+  virtual ~RunnerBase() = default;
 
-  void startWait() {
-    waitStarted_ = std::chrono::steady_clock::now();
+  // io_uring rings set up with no_mmap live in here. being in the base it is
+  // only freed after the runner has torn its ring down
+  void keepRingMemory(Buffer&& b) {
+    ringMemory_ = std::move(b);
   }
 
-  void doneWait() {
-    auto now = std::chrono::steady_clock::now();
-    // anything under 100us seems to be very noisy
-    static constexpr std::chrono::microseconds kEpsilon{100};
-    if (now > waitStarted_ + kEpsilon) {
-      idle_ += (now - waitStarted_);
-    }
+  // must be called on the thread that runs loop()
+  void startCpuAccounting() {
+    cpu_.start();
+    bytesAtCpuStart_ = bytesRx_;
+    requestsAtCpuStart_ = requestsRx_;
   }
 
-  void doneLoop(
-      size_t bytes,
-      size_t requests,
-      unsigned int reads,
-      bool is_overflow = false) {
-    auto const now = std::chrono::steady_clock::now();
-    auto const duration = now - lastStats_;
-    ++loops_;
-
-    if (is_overflow) {
-      ++overflows_;
+  void logSummary() {
+    logCpuPerByte();
+    logSeries();
+    if (!timestamps_.empty()) {
+      log(name_, ": kernel timestamps", timestamps_.toString());
+      timestamps_ = {};
     }
-
-    if (countReads_) {
-      reads_.push_back(reads);
-    }
-
-    if (duration >= std::chrono::seconds(1)) {
-      doLog(bytes, requests, now, duration);
+    if (!residenceCount_) {
+      return;
     }
+    log(name_,
+        ": server residence (percentiles rounded up to a power of two) {",
+        residenceResult().toString(),
+        "}");
+    log(name_, ": server residence histogram ", residenceHistogram());
+    residenceBuckets_.clear();
+    residenceCount_ = 0;
+    residenceTotal_ = {};
+    residenceMax_ = {};
   }
 
- private:
-  std::chrono::milliseconds getMs(clock_t from, clock_t to) {
-    return std::chrono::milliseconds(
-        to <= from ? 0llu : (((to - from) * 1000llu) / ticksPerSecond_));
-  }
-
-  template <size_t N>
-  int getReadStats(std::array<char, N>& arr) {
-    if (!reads_.size()) {
-      return 0;
-    }
-
-    std::sort(reads_.begin(), reads_.end());
-    size_t tot = std::accumulate(reads_.begin(), reads_.end(), size_t(0));
-    double avg = tot / (double)reads_.size();
-    unsigned int p10 = reads_[reads_.size() / 10];
-    unsigned int p50 = reads_[reads_.size() / 2];
-    unsigned int p90 = reads_[(int)(reads_.size() * 0.9)];
-    return snprintf(
-        arr.data(),
-        arr.size(),
-        " read_per_loop: p10=%u p50=%u p90=%u avg=%.2f",
-        p10,
-        p50,
-        p90,
-        avg);
-  }
-
-  void doLog(
-      size_t bytes,
-      size_t requests,
-      std::chrono::steady_clock::time_point now,
-      std::chrono::steady_clock::duration duration) {
-    using namespace std::chrono;
-    uint64_t const millis = duration_cast<milliseconds>(duration).count();
-    double bps = ((bytes - lastBytes_) * 1000.0) / millis;
-    double rps = ((requests - lastRequests_) * 1000.0) / millis;
-    struct tms times_now {};
-    clock_t clock_now = checkedErrno(::times(&times_now), "loop times");
-
-    if (requests > lastRequests_ && lastRps_) {
-      char buff[2048];
-      // use snprintf as I like the floating point formatting
-      int written = snprintf(
-          buff,
-          sizeof(buff),
-          "%s: rps:%6.2fk Bps:%6.2fM idle=%lums "
-          "user=%lums system=%lums wall=%lums loops=%lu overflows=%lu",
-          name_.c_str(),
-          rps / 1000.0,
-          bps / 1000000.0,
-          duration_cast<milliseconds>(idle_).count(),
-          getMs(lastTimes_.tms_utime, times_now.tms_utime).count(),
-          getMs(lastTimes_.tms_stime, times_now.tms_stime).count(),
-          getMs(lastClock_, clock_now).count(),
-          loops_,
-          overflows_);
-      if (written >= 0) {
-        std::array<char, 2048> read_stats_buf;
-        std::string_view read_stats;
-        if (countReads_) {
-          read_stats = std::string_view(
-              read_stats_buf.data(), getReadStats(read_stats_buf));
-          reads_.clear();
-        }
-
-        log(std::string_view(buff, written), read_stats);
-      }
+  void logSeries() {
+    if (!series_.empty()) {
+      log(name_, ": time series\n", series_.toString("  ", "overflows"));
+      series_ = {};
     }
-    loops_ = overflows_ = 0;
-    idle_ = steady_clock::duration{0};
-    lastClock_ = clock_now;
-    lastTimes_ = times_now;
-    lastBytes_ = bytes;
-    lastRequests_ = requests;
-    lastStats_ = now;
-    lastRps_ = rps;
-  }
-
- private:
-  std::string const& name_;
-  bool const countReads_;
-  std::vector<unsigned int> reads_;
-  std::chrono::steady_clock::time_point started_ =
-      std::chrono::steady_clock::now();
-  std::chrono::steady_clock::time_point lastStats_ =
-      std::chrono::steady_clock::now();
-
-  std::chrono::steady_clock::time_point waitStarted;
-  std::chrono::steady_clock::duration totalWaited{0};
-  uint64_t ticksPerSecond_ = sysconf(_SC_CLK_TCK);
-  struct tms lastTimes_;
-  clock_t lastClock_;
-  uint64_t loops_ = 0;
-  uint64_t overflows_ = 0;
-
-  std::chrono::steady_clock::time_point waitStarted_;
-  std::chrono::steady_clock::duration idle_{0};
-  size_t lastBytes_ = 0;
-  size_t lastRequests_ = 0;
-  size_t lastRps_ = 0;
-};
-
-class RunnerBase {
- public:
-  explicit RunnerBase(std::string const& name) : name_(name) {}
-  std::string const& name() const {
-    return name_;
   }
-  virtual void start() {}
-  virtual void loop(std::atomic<bool>* should_shutdown) = 0;
-  virtual void stop() = 0;
-  virtual void addListenSock(int fd, bool v6) = 0;
-  virtual ~RunnerBase() = default;
 
  protected:
   void didRead(int x) {
@@ -469,9 +265,34 @@ class RunnerBase {
   }
 
   void finishedRequests(int n) {
+    if (n) {
+      NETBENCH_TRACE1(request_parsed, n);
+    }
     requestsRx_ += n;
   }
 
+  void rxEvent(RxEvent e, uint64_t value = 0) {
+    RxEventLog::get().add(rxEventSource_, e, value);
+  }
+
+  // time from a request being parsed until its response was sent. only
+  // bucketed, so memory does not grow with the number of requests
+  void finishedResidence(
+      std::chrono::steady_clock::time_point parsed_at,
+      uint32_t count) {
+    auto const d = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - parsed_at);
+    uint64_t const us = std::max<int64_t>(d.count(), 0);
+    size_t const b = us ? 64 - __builtin_clzll(us) : 0;
+    if (b >= residenceBuckets_.size()) {
+      residenceBuckets_.resize(b + 1);
+    }
+    residenceBuckets_[b] += count;
+    residenceCount_ += count;
+    residenceTotal_ += d * count;
+    residenceMax_ = std::max(residenceMax_, d);
+  }
+
   void newSock() {
     socks_++;
     if (socks_ % 100 == 0) {
@@ -490,363 +311,139 @@ class RunnerBase {
     return socks_;
   }
 
-  size_t requestsRx_ = 0;
-  size_t bytesRx_ = 0;
-
- private:
-  std::string const name_;
-  int socks_ = 0;
-};
-
-class NullRunner : public RunnerBase {
- public:
-  explicit NullRunner(std::string const& name) : RunnerBase(name) {}
-  void loop(std::atomic<bool>*) override {}
-  void stop() override {}
-  void addListenSock(int fd, bool) override {
-    close(fd);
-  }
-};
-
-class BufferProviderV1 : private boost::noncopyable {
- public:
-  static constexpr int kBgid = 1;
-
-  explicit BufferProviderV1(IoUringRxConfig const& rx_cfg)
-      : sizePerBuffer_(addAlignment(rx_cfg.recv_size)),
-        lowWatermark_(rx_cfg.provided_buffer_low_watermark) {
-    auto count = rx_cfg.provided_buffer_count;
-    buffer_.resize(count * sizePerBuffer_);
-    for (ssize_t i = 0; i < count; i++) {
-      buffers_.push_back(buffer_.data() + i * sizePerBuffer_);
-    }
-    toProvide_.reserve(128);
-    toProvide2_.reserve(128);
-    toProvide_.emplace_back(0, count);
-    toProvideCount_ = count;
-  }
-
-  size_t count() const {
-    return buffers_.size();
-  }
-
-  size_t sizePerBuffer() const {
-    return sizePerBuffer_;
-  }
-
-  size_t toProvideCount() const {
-    return toProvideCount_;
-  }
-
-  bool canProvide() const {
-    return toProvide_.size();
-  }
-
-  bool needsToProvide() const {
-    return toProvideCount_ > lowWatermark_;
-  }
-
-  void initialRegister(struct io_uring*) {}
-
-  void compact() {
-    if (toProvide_.size() <= 1) {
-      return;
-    } else if (toProvide_.size() == 2) {
-      // actually a common case due to the way the kernel internals work
-      if (toProvide_[0].merge(toProvide_[1])) {
-        toProvide_.pop_back();
-      }
-      return;
-    }
-    auto was = toProvide_.size();
-    std::sort(
-        toProvide_.begin(), toProvide_.end(), [](auto const& a, auto const& b) {
-          return a.sortable < b.sortable;
-        });
-    toProvide2_.clear();
-    toProvide2_.push_back(toProvide_[0]);
-    for (size_t i = 1; i < toProvide_.size(); i++) {
-      auto const& p = toProvide_[i];
-      if (!toProvide2_.back().merge(p)) {
-        toProvide2_.push_back(p);
-      }
+  // per interval requests and bytes received and CQ overflows, for
+  // RxStats. started by the first call
+  TimeSeries* rxSeries(Config const& cfg) {
+    uint64_t const ms = cfg.send_options.series_interval_ms;
+    if (!ms) {
+      return nullptr;
     }
-    toProvide_.swap(toProvide2_);
-    if (unlikely(isVerbose())) {
-      vlog("compact() was ", was, " now ", toProvide_.size());
-      for (auto const& t : toProvide_) {
-        vlog("...", t.start, " count=", t.count);
-      }
-    }
-  }
-
-  void returnIndex(uint16_t i) {
-    if (toProvide_.empty()) {
-      toProvide_.emplace_back(i);
-    } else if (toProvide_.back().merge(i)) {
-      // yay, nothing to do
-    } else if (
-        toProvide_.size() >= 2 && toProvide_[toProvide_.size() - 2].merge(i)) {
-      // yay too, try merge these two. this accounts for out of order by 1 index
-      // where we receive 1,3,2. so we merge 2 into 3, and then (2,3) into 1
-      if (toProvide_[toProvide_.size() - 2].merge(toProvide_.back())) {
-        toProvide_.pop_back();
-      }
-    } else {
-      toProvide_.emplace_back(i);
+    if (!series_.enabled()) {
+      series_ = TimeSeries(
+          std::chrono::milliseconds(ms), std::chrono::steady_clock::now());
     }
-    ++toProvideCount_;
-  }
-
-  void provide(struct io_uring_sqe* sqe) {
-    Range const& r = toProvide_.back();
-    io_uring_prep_provide_buffers(
-        sqe, buffers_[r.start], sizePerBuffer_, r.count, kBgid, r.start);
-    sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;
-    toProvideCount_ -= r.count;
-    toProvide_.pop_back();
-    assert(toProvide_.size() != 0 || toProvideCount_ == 0);
+    return &series_;
   }
 
-  char const* getData(uint16_t i) const {
-    return buffers_[i];
-  }
+  size_t requestsRx_ = 0;
+  size_t bytesRx_ = 0;
+  TimestampStats timestamps_;
 
  private:
-  static constexpr int kAlignment = 32;
-
-  size_t addAlignment(size_t n) {
-    return kAlignment * ((n + kAlignment - 1) / kAlignment);
-  }
-
-  struct Range {
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-    explicit Range(uint16_t idx, uint16_t count = 1)
-        : count(count), start(idx) {}
-#else
-    explicit Range(uint16_t idx, uint16_t count = 1)
-        : start(idx), count(count) {}
-#endif
-    union {
-      struct {
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-        uint16_t count;
-        uint16_t start;
-#else
-        uint16_t start;
-        uint16_t count;
-#endif
-      };
-      uint32_t sortable; // big endian might need to swap these around
-    };
-
-    bool merge(uint16_t idx) {
-      if (idx == start - 1) {
-        start = idx;
-        count++;
-        return true;
-      } else if (idx == start + count) {
-        count++;
-        return true;
-      } else {
-        return false;
-      }
-    }
-
-    bool merge(Range const& r) {
-      if (start + count == r.start) {
-        count += r.count;
-        return true;
-      } else if (r.start + r.count == start) {
-        count += r.count;
-        start = r.start;
-        return true;
-      } else {
-        return false;
+  // bucket b > 0 holds residences in [2^(b-1), 2^b) microseconds
+  std::string residenceHistogram() const {
+    std::string ret;
+    for (size_t b = 0; b < residenceBuckets_.size(); b++) {
+      if (!residenceBuckets_[b]) {
+        continue;
       }
+      ret += strcat(
+          " <", b ? (1LLU << b) : 1LLU, "us:", residenceBuckets_[b]);
     }
-  };
-
-  size_t sizePerBuffer_;
-  std::vector<char, boost::alignment::aligned_allocator<char, kAlignment>>
-      buffer_;
-  std::vector<char*> buffers_;
-  ssize_t toProvideCount_ = 0;
-  int lowWatermark_;
-  std::vector<Range> toProvide_;
-  std::vector<Range> toProvide2_;
-};
-
-class BufferProviderV2 : private boost::noncopyable {
- private:
- public:
-  static constexpr int kBgid = 1;
-  static constexpr size_t kHugePageMask = (1LLU << 21) - 1; // 2MB
-  static constexpr size_t kBufferAlignMask = 31LLU;
-
-  explicit BufferProviderV2(IoUringRxConfig const& rx_cfg)
-      : count_(rx_cfg.provided_buffer_count),
-        sizePerBuffer_(addAlignment(rx_cfg.recv_size)) {
-    ringSize_ = 1;
-    ringMask_ = 0;
-    while (ringSize_ < count_) {
-      ringSize_ *= 2;
-    }
-    ringMask_ = io_uring_buf_ring_mask(ringSize_);
-
-    int extra_mmap_flags = 0;
-    char* buffer_base;
-
-    ringMemSize_ = ringSize_ * sizeof(struct io_uring_buf);
-    ringMemSize_ = (ringMemSize_ + kBufferAlignMask) & (~kBufferAlignMask);
-    bufferMmapSize_ = count_ * sizePerBuffer_ + ringMemSize_;
-    size_t page_mask = 4095;
-
-    if (rx_cfg.huge_pages) {
-      bufferMmapSize_ = (bufferMmapSize_ + kHugePageMask) & (~kHugePageMask);
-      extra_mmap_flags |= MAP_HUGETLB;
-      page_mask = kHugePageMask;
-      checkHugePages(bufferMmapSize_ / (1 + kHugePageMask));
-    }
-
-    bufferMmap_ = mmap(
-        NULL,
-        bufferMmapSize_,
-        PROT_READ | PROT_WRITE,
-        MAP_ANONYMOUS | MAP_PRIVATE | extra_mmap_flags,
-        -1,
-        0);
-    vlog(
-        "mmap buffer size=",
-        bufferMmapSize_,
-        " ring size=",
-        ringMemSize_,
-        " pages=",
-        bufferMmapSize_ / (1 + page_mask));
-    if (bufferMmap_ == MAP_FAILED) {
-      auto errnoCopy = errno;
-      die("unable to allocate pages of size ",
-          bufferMmapSize_,
-          ": ",
-          strerror(errnoCopy));
-    }
-    buffer_base = (char*)bufferMmap_ + ringMemSize_;
-    ring_ = (struct io_uring_buf_ring*)bufferMmap_;
-    io_uring_buf_ring_init(ring_);
-    for (size_t i = 0; i < count_; i++) {
-      buffers_.push_back(buffer_base + i * sizePerBuffer_);
-    }
-
-    if (count_ >= std::numeric_limits<uint16_t>::max()) {
-      die("buffer count too large: ", count_);
-    }
-    for (uint16_t i = 0; i < count_; i++) {
-      ring_->bufs[i] = {};
-      populate(ring_->bufs[i], i);
-    }
-    tailCached_ = count_;
-    io_uring_smp_store_release(&ring_->tail, tailCached_);
-
-    vlog(
-        "ring address=",
-        ring_,
-        " ring size=",
-        ringSize_,
-        " buffer count=",
-        count_,
-        " ring_mask=",
-        ringMask_,
-        " tail now ",
-        tailCached_);
-  }
-
-  ~BufferProviderV2() {
-    munmap(bufferMmap_, bufferMmapSize_);
-  }
-
-  size_t count() const {
-    return count_;
-  }
-
-  size_t sizePerBuffer() const {
-    return sizePerBuffer_;
-  }
-
-  size_t toProvideCount() const {
-    return cachedIndices;
-  }
-
-  bool canProvide() const {
-    return false;
-  }
-
-  bool needsToProvide() const {
-    return false;
+    return ret;
   }
 
-  void compact() {}
-
-  inline void populate(struct io_uring_buf& b, uint16_t i) {
-    b.bid = i;
-    b.addr = (__u64)getData(i);
-
-    // can we assume kernel doesnt touch len or resv?
-    b.len = sizePerBuffer_;
-    // b.resv = 0;
+  // percentiles are the top of the bucket they fall in, at most the max
+  LatencyResult residenceResult() const {
+    auto at = [this](double q) {
+      size_t const idx = (size_t)(residenceCount_ * q);
+      size_t seen = 0;
+      for (size_t b = 0; b < residenceBuckets_.size(); b++) {
+        seen += residenceBuckets_[b];
+        if (seen > idx) {
+          return std::min(
+              residenceMax_, std::chrono::microseconds((1LL << b) - 1));
+        }
+      }
+      return residenceMax_;
+    };
+    LatencyResult ret;
+    ret.count = residenceCount_;
+    ret.p100 = residenceMax_;
+    ret.p999 = at(0.999);
+    ret.p99 = at(0.99);
+    ret.p95 = at(0.95);
+    ret.p50 = at(0.5);
+    ret.avg = residenceTotal_ / residenceCount_;
+    return ret;
   }
 
-  void returnIndex(uint16_t i) {
-    indices[cachedIndices++] = i;
-    if (likely(cachedIndices < indices.size())) {
+  void logCpuPerByte() {
+    size_t const bytes = bytesRx_ - bytesAtCpuStart_;
+    size_t const requests = requestsRx_ - requestsAtCpuStart_;
+    if (!bytes) {
       return;
     }
-    cachedIndices = 0;
-    for (uint16_t idx : indices) {
-      populate(ring_->bufs[(tailCached_ & ringMask_)], idx);
-      ++tailCached_;
-    }
-
-    io_uring_smp_store_release(&ring_->tail, tailCached_);
+    auto const u = cpu_.sample();
+    double const cpu_s = std::chrono::duration<double>(u.cpu).count();
+    log(name_,
+        ": cpu=",
+        (int)(cpu_s * 1000),
+        "ms gbitPerCore=",
+        cpu_s > 0 ? (bytes * 8) / cpu_s / 1e9 : 0.0,
+        u.cycles ? strcat(" cyclesPerByte=", (double)*u.cycles / bytes) : "",
+        u.instructions
+            ? strcat(" instructionsPerByte=", (double)*u.instructions / bytes)
+            : "",
+        u.instructions && requests
+            ? strcat(
+                  " instructionsPerRequest=",
+                  (double)*u.instructions / requests)
+            : "",
+        u.dtlb_misses ? strcat(" dtlbMissesPerMB=", *u.dtlb_misses * 1e6 / bytes)
+                      : "",
+        u.page_faults ? strcat(" pageFaults=", *u.page_faults) : "");
   }
 
-  void provide(struct io_uring_sqe*) {}
-
-  char const* getData(uint16_t i) const {
-    return buffers_[i];
-  }
+  std::string const name_;
+  int socks_ = 0;
+  // power of two histogram of residence times, see residenceHistogram()
+  std::vector<size_t> residenceBuckets_;
+  size_t residenceCount_ = 0;
+  std::chrono::microseconds residenceTotal_{0};
+  std::chrono::microseconds residenceMax_{0};
+  ThreadCpu cpu_;
+  size_t bytesAtCpuStart_ = 0;
+  size_t requestsAtCpuStart_ = 0;
+  uint32_t const rxEventSource_;
+  TimeSeries series_;
+  Buffer ringMemory_;
+};
 
-  void initialRegister(struct io_uring* ring) {
-    struct io_uring_buf_reg reg;
-    memset(&reg, 0, sizeof(reg));
-    reg.ring_addr = (__u64)ring_;
-    reg.ring_entries = ringSize_;
-    reg.bgid = kBgid;
-    checkedErrno(io_uring_register_buf_ring(ring, &reg, 0), "register pbuf");
+class NullRunner : public RunnerBase {
+ public:
+  explicit NullRunner(std::string const& name) : RunnerBase(name) {}
+  void loop(std::atomic<bool>*) override {}
+  void stop() override {}
+  void addListenSock(int fd, bool) override {
+    close(fd);
   }
-
- private:
-  static constexpr int kAlignment = 32;
-
-  size_t addAlignment(size_t n) {
-    return kAlignment * ((n + kAlignment - 1) / kAlignment);
-  }
-
-  size_t count_;
-  size_t sizePerBuffer_;
-  size_t bufferMmapSize_ = 0;
-  void* bufferMmap_ = nullptr;
-  std::vector<char*> buffers_;
-  uint16_t tailCached_ = 0;
-  size_t ringMemSize_;
-  uint32_t ringSize_;
-  uint32_t ringMask_;
-  uint32_t cachedIndices = 0;
-  struct io_uring_buf_ring* ring_;
-  std::array<uint16_t, 32> indices;
 };
 
+
 static constexpr int kUseBufferProviderFlag = 1;
 static constexpr int kUseBufferProviderV2Flag = 2;
+// with kSpecializedFlag the options below are fixed at compile time, rather
+// than read from the config on every call
+static constexpr int kSpecializedFlag = 4;
+static constexpr int kFixedFilesFlag = 8;
+static constexpr int kMultishotRecvFlag = 16;
+static constexpr int kRecvmsgFlag = 32;
+static constexpr int kCqeSkipSuccessFlag = 64;
+static constexpr size_t kIoUringFlagCombinations = 128;
+
+// a loop handling this many completions is an RxEvent, as the last of them
+// waited for all the others
+static constexpr int kLongCqeBatch = 1024;
+
+constexpr bool isValidIoUringFlags(size_t flags) {
+  if ((flags & kUseBufferProviderFlag) && (flags & kUseBufferProviderV2Flag)) {
+    return false;
+  }
+  // unspecialized runners only vary by buffer provider
+  return (flags & kSpecializedFlag) ||
+      !(flags & ~(size_t)(kUseBufferProviderFlag | kUseBufferProviderV2Flag));
+}
 
 int providedBufferIdx(struct io_uring_cqe* cqe) {
   if (!(cqe->flags & IORING_CQE_F_BUFFER)) {
@@ -866,22 +463,51 @@ struct BasicSock {
       kUseBufferProviderVersion == 2,
       BufferProviderV2,
       BufferProviderV1>;
+  using TBufferPool = BufferPool<TBufferProvider>;
+
+  static constexpr size_t kFlags = Flags;
+  static constexpr bool kSpecialized = Flags & kSpecializedFlag;
 
   bool isFixedFiles() const {
+    if constexpr (kSpecialized) {
+      return Flags & kFixedFilesFlag;
+    }
     return cfg_.fixed_files;
   }
 
   bool isMultiShotRecv() const {
+    if constexpr (kSpecialized) {
+      return Flags & kMultishotRecvFlag;
+    }
     return cfg_.multishot_recv;
   }
 
+  bool isRecvmsg() const {
+    if constexpr (kSpecialized) {
+      return Flags & kRecvmsgFlag;
+    }
+    return cfg_.recvmsg;
+  }
+
+  unsigned int cqeSkipSuccessFlag() const {
+    if constexpr (kSpecialized) {
+      return (Flags & kCqeSkipSuccessFlag) ? IOSQE_CQE_SKIP_SUCCESS : 0;
+    }
+    return cfg_.cqe_skip_success_flag;
+  }
+
   explicit BasicSock(IoUringRxConfig const& cfg, int fd) : cfg_(cfg), fd_(fd) {
-    if (cfg_.recvmsg) {
+    if (isRecvmsg()) {
       memset(&recvmsgHdr_, 0, sizeof(recvmsgHdr_));
       memset(&recvmsgHdrIoVec_, 0, sizeof(recvmsgHdrIoVec_));
       recvmsgHdr_.msg_iov = &recvmsgHdrIoVec_;
       recvmsgHdrIoVec_.iov_base = &buff[0];
       recvmsgHdrIoVec_.iov_len = ReadSize;
+      if (cfg_.timestamping) {
+        // for multishot this is just the space reserved in each buffer
+        recvmsgHdr_.msg_control = control_.data();
+        recvmsgHdr_.msg_controllen = control_.size();
+      }
       if (isMultiShotRecv() || kUseBufferProviderVersion > 0) {
         recvmsgHdr_.msg_iovlen = 0;
       } else {
@@ -913,14 +539,114 @@ struct BasicSock {
     if (isFixedFiles()) {
       sqe->flags |= IOSQE_FIXED_FILE;
     }
-    sqe->flags |= cfg_.cqe_skip_success_flag;
+    sqe->flags |= cqeSkipSuccessFlag();
+    if (!cqeSkipSuccessFlag()) {
+      ++sendsInFlight_;
+    }
+    if (cfg_.timestamping) {
+      ts_.sent(len);
+    }
+  }
+
+  // echo sends always need a completion to know when the data they point
+  // into can be reused. io_uring does not keep separate sends to one socket
+  // in order, so they are queued here and only one is in flight at a time
+  void queueEchoSend(
+      unsigned char const* b,
+      uint32_t len,
+      uint64_t user_data) {
+    echoQueue_.push_back(QueuedEcho{b, len, user_data});
+    ++sendsInFlight_;
+  }
+
+  bool echoSendReady() const {
+    return !echoInFlight_ && !echoQueue_.empty();
+  }
+
+  // prepares the next queued echo send, returning its user_data
+  uint64_t addEchoSend(struct io_uring_sqe* sqe) {
+    QueuedEcho const e = echoQueue_.front();
+    echoQueue_.pop_front();
+    io_uring_prep_send(sqe, fd_, e.data, e.len, MSG_WAITALL);
+    if (isFixedFiles()) {
+      sqe->flags |= IOSQE_FIXED_FILE;
+    }
+    echoInFlight_ = true;
+    return e.user_data;
   }
 
-  void addRead(struct io_uring_sqe* sqe, TBufferProvider& provider) {
+  void doneEchoSend() {
+    echoInFlight_ = false;
+    doneSend();
+  }
+
+  // user_data of the next queued echo send, dropping it unsent. 0 if none
+  uint64_t dropEchoSend() {
+    if (echoQueue_.empty()) {
+      return 0;
+    }
+    uint64_t const ret = echoQueue_.front().user_data;
+    echoQueue_.pop_front();
+    doneSend();
+    return ret;
+  }
+
+  // payload runs seen since the last clearEcho(), only kept in echo mode
+  std::vector<std::pair<char const*, uint32_t>> const& echoSegments() const {
+    return echo_;
+  }
+
+  void clearEcho() {
+    echo_.clear();
+  }
+
+  void drainTimestamps(TimestampStats& stats) {
+    ts_.drainErrQueue(fd_, stats);
+  }
+
+  // the socket must outlive any sends that will still post a completion
+  uint32_t sendsInFlight() const {
+    return sendsInFlight_;
+  }
+
+  // responses held back by max_sends_in_flight. their requests are already
+  // counted
+  ConsumeResults& deferred() {
+    return deferred_;
+  }
+
+  void doneSend() {
+    if (sendsInFlight_) {
+      --sendsInFlight_;
+    }
+  }
+
+  void pushResidence(
+      std::chrono::steady_clock::time_point parsed_at,
+      uint32_t count) {
+    residence_.emplace_back(parsed_at, count);
+  }
+
+  std::optional<std::pair<std::chrono::steady_clock::time_point, uint32_t>>
+  popResidence() {
+    if (residence_.empty()) {
+      return std::nullopt;
+    }
+    auto ret = residence_.front();
+    residence_.pop_front();
+    return ret;
+  }
+
+  void addRead(struct io_uring_sqe* sqe, TBufferPool& pool) {
+    if (cfg_.timestamping && !isMultiShotRecv()) {
+      recvmsgHdr_.msg_controllen = control_.size();
+    }
     if (kUseBufferProviderVersion) {
+      auto const& provider = pool.pick(parser.pending());
       size_t const size = isMultiShotRecv() ? 0LLU : provider.sizePerBuffer();
+      armedBgid_ = provider.bgid();
 
-      if (cfg_.recvmsg) {
+      if (isRecvmsg()) {
         io_uring_prep_recvmsg(sqe, fd_, &recvmsgHdr_, 0);
         if (isMultiShotRecv()) {
           sqe->ioprio |= IORING_RECV_MULTISHOT;
@@ -933,8 +659,8 @@ struct BasicSock {
         }
       }
       sqe->flags |= IOSQE_BUFFER_SELECT;
-      sqe->buf_group = TBufferProvider::kBgid;
-    } else if (cfg_.recvmsg) {
+      sqe->buf_group = provider.bgid();
+    } else if (isRecvmsg()) {
       io_uring_prep_recvmsg(sqe, fd_, &recvmsgHdr_, 0);
     } else {
       io_uring_prep_recv(sqe, fd_, &buff[0], sizeof(buff), 0);
@@ -949,13 +675,26 @@ struct BasicSock {
     return closed_;
   }
 
-  void doClose() {
-    closed_ = true;
-    ::close(fd_);
+  bool closeDone() const {
+    return closeDone_;
   }
 
-  void addClose(struct io_uring_sqe* sqe) {
-    closed_ = true;
+  // buffer group of the last read armed
+  int armedBgid() const {
+    return armedBgid_;
+  }
+
+  void setCloseDone() {
+    closeDone_ = true;
+  }
+
+  void doClose() {
+    closed_ = closeDone_ = true;
+    ::close(fd_);
+  }
+
+  void addClose(struct io_uring_sqe* sqe) {
+    closed_ = true;
     if (isFixedFiles())
       io_uring_prep_close_direct(sqe, fd_);
     else
@@ -970,7 +709,10 @@ struct BasicSock {
     int recycleBufferIdx;
   };
 
-  DidReadResult didRead(TBufferProvider& provider, struct io_uring_cqe* cqe) {
+  DidReadResult didRead(
+      TBufferPool& provider,
+      struct io_uring_cqe* cqe,
+      TimestampStats& stats) {
     // pull remaining data
     int res = cqe->res;
     if (res <= 0) {
@@ -981,7 +723,7 @@ struct BasicSock {
       int recycleBufferIdx = providedBufferIdx(cqe);
       auto* data = provider.getData(recycleBufferIdx);
 
-      if (isMultiShotRecv() && cfg_.recvmsg) {
+      if (isMultiShotRecv() && isRecvmsg()) {
         if (recycleBufferIdx < 0) {
           die("bad recycleBufferIdx");
         }
@@ -992,13 +734,26 @@ struct BasicSock {
         if (!m) {
           return DidReadResult(0, recycleBufferIdx);
         }
+        if (cfg_.timestamping) {
+          for (auto* cmsg = io_uring_recvmsg_cmsg_firsthdr(m, &recvmsgHdr_);
+               cmsg;
+               cmsg = io_uring_recvmsg_cmsg_nexthdr(m, &recvmsgHdr_, cmsg)) {
+            SocketTimestamps::readRx(cmsg, stats);
+          }
+        }
         res = io_uring_recvmsg_payload_length(m, cqe->res, &recvmsgHdr_);
         data = (const char*)io_uring_recvmsg_payload(m, &recvmsgHdr_);
       }
 
+      if (cfg_.timestamping && !isMultiShotRecv()) {
+        SocketTimestamps::readRx(&recvmsgHdr_, stats);
+      }
       didRead(data, res);
       return DidReadResult(res, recycleBufferIdx);
     } else {
+      if (cfg_.timestamping) {
+        SocketTimestamps::readRx(&recvmsgHdr_, stats);
+      }
       didRead(buff, res);
       return DidReadResult(res, -1);
     }
@@ -1006,7 +761,18 @@ struct BasicSock {
 
  private:
   void didRead(char const* b, size_t n) {
-    auto consumed = parser.consume(b, n);
+    ConsumeResults consumed;
+    if (cfg_.echo) {
+      consumed = parser.consume(b, n, [this](char const* data, size_t len) {
+        echo_.emplace_back(data, len);
+      });
+      consumed.to_write = 0;
+    } else {
+      consumed = parser.consume(b, n);
+    }
+    if (cfg_.residence_time && consumed.count) {
+      consumed.parsed_at = std::chrono::steady_clock::now();
+    }
     runWorkload(cfg_, consumed.count);
     do_send += consumed;
   }
@@ -1016,8 +782,24 @@ struct BasicSock {
   ProtocolParser parser;
   ConsumeResults do_send;
   bool closed_ = false;
+  bool closeDone_ = false;
+  int armedBgid_ = 0;
+  uint32_t sendsInFlight_ = 0;
+  ConsumeResults deferred_;
+  std::deque<std::pair<std::chrono::steady_clock::time_point, uint32_t>>
+      residence_;
   struct msghdr recvmsgHdr_;
   struct iovec recvmsgHdrIoVec_;
+  SocketTimestamps ts_;
+  std::array<char, SocketTimestamps::kControlSize> control_;
+  std::vector<std::pair<char const*, uint32_t>> echo_;
+  struct QueuedEcho {
+    unsigned char const* data;
+    uint32_t len;
+    uint64_t user_data;
+  };
+  std::deque<QueuedEcho> echoQueue_;
+  bool echoInFlight_ = false;
 
   char buff[ReadSize];
 };
@@ -1053,12 +835,23 @@ struct IOUringRunner : public RunnerBase {
       struct io_uring r,
       std::string const& name)
       : RunnerBase(name), cfg_(cfg), rxCfg_(rx_cfg), ring(r), buffers_(rx_cfg) {
-    sendBuff_.resize(2048);
+    sendBuff_ = Buffer(2048, rx_cfg.buffers);
+    if (rx_cfg.echo && TSock::kUseBufferProviderVersion) {
+      echoRefs_.resize(buffers_.bidLimit());
+    }
 
     if (TSock::kUseBufferProviderVersion) {
+      auto const started = std::chrono::steady_clock::now();
       buffers_.initialRegister(&ring);
       provideBuffers(true);
       submit();
+      auto const took = std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - started);
+      if (rx_cfg.pbuf_ring_mmap) {
+        log("provided buffer setup took ", took.count(), "us (kernel ring)");
+      } else {
+        vlog("provided buffer setup took ", took.count(), "us");
+      }
     }
 
     if (isFixedFiles()) {
@@ -1080,6 +873,9 @@ struct IOUringRunner : public RunnerBase {
           stopping);
     }
 
+    for (auto* e : freeEchoSends_) {
+      delete e;
+    }
     io_uring_queue_exit(&ring);
   }
 
@@ -1094,18 +890,34 @@ struct IOUringRunner : public RunnerBase {
     if (rxCfg_.provided_buffer_compact) {
       buffers_.compact();
     }
+    int provided = 0;
     while (buffers_.canProvide()) {
       auto* sqe = get_sqe();
       buffers_.provide(sqe);
       io_uring_sqe_set_data(sqe, NULL);
+      ++provided;
     }
+    NETBENCH_TRACE1(buffer_replenish, provided);
   }
 
   static constexpr int kAccept = 1;
   static constexpr int kRead = 2;
   static constexpr int kWrite = 3;
+  static constexpr int kEcho = 4;
   static constexpr int kOther = 0;
 
+  // an echo send straight out of the buffer the data arrived in. the buffer
+  // is only recycled once every send pointing into it has completed
+  struct alignas(16) EchoSend {
+    TSock* sock = nullptr;
+    int bufferIdx = -1;
+    // for when the data is in the socket's own buffer, which gets reused
+    std::vector<unsigned char> copy;
+    // requests whose responses end with this send, for residence time
+    uint32_t count = 0;
+    std::chrono::steady_clock::time_point parsed_at;
+  };
+
   void addListenSock(int fd, bool v6) override {
     listeners_++;
     listenSocks_.push_back(std::make_unique<ListenSock>(fd, v6));
@@ -1156,11 +968,28 @@ struct IOUringRunner : public RunnerBase {
 
   void addSend(TSock* sock, uint32_t len) {
     if (unlikely(sendBuff_.size() < len)) {
-      sendBuff_.resize(len);
+      // sends in flight (which wait a long time on full sockets) still point
+      // into the old buffer, so it is never freed. doubling bounds the waste
+      Buffer bigger(
+          std::max<size_t>(len, sendBuff_.size() * 2), rxCfg_.buffers);
+      retiredSendBuffs_.push_back(std::move(sendBuff_));
+      sendBuff_ = std::move(bigger);
     }
     struct io_uring_sqe* sqe = get_sqe();
-    sock->addSend(sqe, sendBuff_.data(), len);
+    sock->addSend(sqe, (unsigned char*)sendBuff_.data(), len);
     io_uring_sqe_set_data(sqe, tag(sock, kWrite));
+    NETBENCH_TRACE1(send_queued, len);
+  }
+
+  void sendResponses(TSock* sock, ConsumeResults const& sends) {
+    addSend(sock, sends.to_write);
+    if (rxCfg_.residence_time) {
+      if (cqeSkipSuccess()) {
+        finishedResidence(sends.parsed_at, sends.count);
+      } else {
+        sock->pushResidence(sends.parsed_at, sends.count);
+      }
+    }
   }
 
   void processAccept(struct io_uring_cqe* cqe) {
@@ -1179,6 +1008,10 @@ struct IOUringRunner : public RunnerBase {
         used_fd = ls->nextAcceptIdx;
         ls->nextAcceptIdx = -1;
       }
+      NETBENCH_TRACE1(accept, used_fd);
+      if (rxCfg_.timestamping) {
+        SocketTimestamps::enable(used_fd);
+      }
       TSock* sock = new TSock(rxCfg_, used_fd);
       addRead(sock);
       newSock();
@@ -1208,6 +1041,10 @@ struct IOUringRunner : public RunnerBase {
           } else if (sock_fd == -1) {
             checkedErrno(sock_fd, "accept4");
           }
+          NETBENCH_TRACE1(accept, sock_fd);
+          if (rxCfg_.timestamping) {
+            SocketTimestamps::enable(sock_fd);
+          }
           TSock* sock = new TSock(rxCfg_, sock_fd);
           addRead(sock);
           newSock();
@@ -1228,22 +1065,170 @@ struct IOUringRunner : public RunnerBase {
       // cannot recycle
       log("unable to close fd, ret=", res);
     }
+    sock->setCloseDone();
+    maybeDeleteSock(sock);
+  }
+
+  void maybeDeleteSock(TSock* sock) {
+    if (!sock->closeDone() || sock->sendsInFlight()) {
+      return;
+    }
     delete sock;
+    delSock();
+  }
+
+  void processWrite(struct io_uring_cqe* cqe) {
+    if (cqeSkipSuccess()) {
+      // only errors arrive here, and as nothing waits for them the socket
+      // may already be deleted, so only the result can be looked at
+      if (cqe->res != -EPIPE && cqe->res != -ECONNRESET) {
+        log("bad socket write ", cqe->res);
+      }
+      return;
+    }
+    TSock* sock = untag<TSock>(cqe->user_data);
+    if (cqe->res < 0) {
+      // we should track these down and make sure they only happen when the
+      // sender socket is closed
+      if (!sock->closing()) {
+        log("bad socket write ",
+            cqe->res,
+            " closing=",
+            sock->closing(),
+            " fd=",
+            sock->fd());
+      }
+    }
+    if (rxCfg_.residence_time) {
+      if (auto r = sock->popResidence()) {
+        finishedResidence(r->first, r->second);
+      }
+    }
+    sock->doneSend();
+    if (unlikely(sock->deferred().to_write)) {
+      // everything held back goes out in one send
+      if (cqe->res >= 0 && !sock->closing()) {
+        sendResponses(sock, sock->deferred());
+        ++aggregatedSends_;
+      }
+      sock->deferred() = {};
+    }
+    maybeDeleteSock(sock);
+  }
+
+  // returns the last send queued, or null if there was nothing to echo
+  EchoSend* addEchoSends(TSock* sock, int buffer_idx) {
+    EchoSend* es = nullptr;
+    for (auto const& [data, len] : sock->echoSegments()) {
+      if (freeEchoSends_.empty()) {
+        es = new EchoSend();
+      } else {
+        es = freeEchoSends_.back();
+        freeEchoSends_.pop_back();
+      }
+      es->sock = sock;
+      es->bufferIdx = buffer_idx;
+      unsigned char const* from = (unsigned char const*)data;
+      if (buffer_idx >= 0) {
+        ++echoRefs_[buffer_idx];
+      } else {
+        es->copy.assign(from, from + len);
+        from = es->copy.data();
+      }
+      sock->queueEchoSend(from, len, (uint64_t)tag(es, kEcho));
+    }
+    sock->clearEcho();
+    addNextEchoSend(sock);
+    return es;
+  }
+
+  void addNextEchoSend(TSock* sock) {
+    if (sock->echoSendReady()) {
+      struct io_uring_sqe* sqe = get_sqe();
+      io_uring_sqe_set_data(sqe, (void*)sock->addEchoSend(sqe));
+    }
+  }
+
+  void releaseEchoSend(EchoSend* es) {
+    if (es->bufferIdx >= 0 && --echoRefs_[es->bufferIdx] == 0) {
+      buffers_.returnIndex(es->bufferIdx);
+      provideBuffers(false);
+    }
+    es->sock = nullptr;
+    es->count = 0;
+    freeEchoSends_.push_back(es);
+  }
+
+  void processEcho(struct io_uring_cqe* cqe) {
+    EchoSend* es = untag<EchoSend>(cqe->user_data);
+    TSock* sock = es->sock;
+    if (cqe->res < 0 && !sock->closing()) {
+      log("bad socket echo write ", cqe->res, " fd=", sock->fd());
+    }
+    if (es->count && cqe->res >= 0) {
+      finishedResidence(es->parsed_at, es->count);
+    }
+    releaseEchoSend(es);
+    sock->doneEchoSend();
+    if (cqe->res < 0 || sock->closing()) {
+      // anything after this would leave a gap in the echoed stream
+      while (uint64_t ud = sock->dropEchoSend()) {
+        releaseEchoSend(untag<EchoSend>(ud));
+      }
+    } else {
+      addNextEchoSend(sock);
+    }
+    maybeDeleteSock(sock);
   }
 
   void processRead(struct io_uring_cqe* cqe) {
     TSock* sock = untag<TSock>(cqe->user_data);
-    auto res = sock->didRead(buffers_, cqe);
+    auto res = sock->didRead(buffers_, cqe, timestamps_);
+    if (res.recycleBufferIdx >= 0) {
+      buffers_.took(res.recycleBufferIdx, cqe->res);
+    }
+
+    EchoSend* last_echo = nullptr;
+    if (rxCfg_.echo && res.amount > 0) {
+      last_echo = addEchoSends(sock, res.recycleBufferIdx);
+    }
 
-    if (res.recycleBufferIdx > 0) {
+    if (res.recycleBufferIdx >= 0 &&
+        (echoRefs_.empty() || !echoRefs_[res.recycleBufferIdx])) {
       buffers_.returnIndex(res.recycleBufferIdx);
       provideBuffers(false);
     }
 
     if (res.amount > 0) {
-      if (auto const& sends = sock->peekSend(); sends.to_write > 0) {
+      if (rxCfg_.timestamping) {
+        sock->drainTimestamps(timestamps_);
+      }
+      if (auto const& sends = sock->peekSend();
+          rxCfg_.echo && sends.count) {
+        // responses were already sent as the data arrived
+        finishedRequests(sends.count);
+        if (rxCfg_.residence_time && last_echo) {
+          // sends are in order, so these are echoed once the end of this
+          // read is. that can include the start of a later request
+          last_echo->parsed_at = sends.parsed_at;
+          last_echo->count = sends.count;
+        } else if (rxCfg_.residence_time) {
+          finishedResidence(sends.parsed_at, sends.count);
+        }
+        sock->didSend();
+      } else if (sends.to_write > 0) {
         finishedRequests(sends.count);
-        addSend(sock, sends.to_write);
+        if (unlikely(
+                rxCfg_.max_sends_in_flight &&
+                sock->sendsInFlight() >=
+                    (uint32_t)rxCfg_.max_sends_in_flight)) {
+          sock->deferred() += sends;
+          ++deferredResponses_;
+          maxDeferredBytes_ =
+              std::max(maxDeferredBytes_, sock->deferred().to_write);
+        } else {
+          sendResponses(sock, sends);
+        }
         sock->didSend();
       }
       didRead(res.amount);
@@ -1252,13 +1237,18 @@ struct IOUringRunner : public RunnerBase {
       }
     } else if (res.amount <= 0) {
       if (unlikely(cqe->res == -ENOBUFS)) {
-        die("not enough buffers, but will just requeue. so far have ",
-            ++enobuffCount_,
-            "state: can provide=",
+        // back off until buffers come back, growing the pool if allowed
+        ++enobuffCount_;
+        rxEvent(RxEvent::Enobufs, sock->armedBgid());
+        vlog(
+            "out of buffers: to provide=",
             buffers_.toProvideCount(),
             " need=",
             buffers_.needsToProvide());
-        addRead(sock);
+        if (buffers_.exhausted(&ring, sock->armedBgid())) {
+          provideBuffers(true);
+        }
+        needsRearm_.push_back(sock);
         return;
       }
       if (cqe->res < 0 && !stopping) {
@@ -1278,12 +1268,24 @@ struct IOUringRunner : public RunnerBase {
         io_uring_sqe_set_data(sqe, tag(sock, kOther));
       } else {
         sock->doClose();
-        delete sock;
-        delSock();
+        maybeDeleteSock(sock);
       }
     }
   }
 
+  // re-arm sockets that ran out of buffers, as many as could get one
+  void rearmStarved() {
+    if (needsRearm_.empty()) {
+      return;
+    }
+    provideBuffers(true);
+    size_t const n = std::min(needsRearm_.size(), buffers_.available());
+    for (size_t i = 0; i < n; i++) {
+      addRead(needsRearm_[i]);
+    }
+    needsRearm_.erase(needsRearm_.begin(), needsRearm_.begin() + n);
+  }
+
   void processCqe(struct io_uring_cqe* cqe, unsigned int& reads) {
     switch (get_tag(cqe->user_data)) {
       case kAccept:
@@ -1295,21 +1297,11 @@ struct IOUringRunner : public RunnerBase {
         break;
       case kWrite:
         // be careful if you do something here as kRead might delete sockets.
-        // this is ok as we only ever have one read outstanding
-        // at once
-        if (cqe->res < 0) {
-          // we should track these down and make sure they only happen when the
-          // sender socket is closed
-          TSock* sock = untag<TSock>(cqe->user_data);
-          if (!sock->closing()) {
-            log("bad socket write ",
-                cqe->res,
-                " closing=",
-                sock->closing(),
-                " fd=",
-                sock->fd());
-          }
-        }
+        // sockets are kept alive while they have sends that will complete
+        processWrite(cqe);
+        break;
+      case kEcho:
+        processEcho(cqe);
         break;
       case kOther:
         if (cqe->user_data) {
@@ -1380,7 +1372,7 @@ struct IOUringRunner : public RunnerBase {
   }
 
   void loop(std::atomic<bool>* should_shutdown) override {
-    RxStats rx_stats{name(), cfg_.print_read_stats};
+    RxStats rx_stats{name(), cfg_.print_read_stats, rxSeries(cfg_)};
     struct __kernel_timespec timeout;
     timeout.tv_sec = 1;
     timeout.tv_nsec = 0;
@@ -1399,6 +1391,7 @@ struct IOUringRunner : public RunnerBase {
       rx_stats.startWait();
 
       if (was_overflow) {
+        rxEvent(RxEvent::CqOverflow);
         flushOverflow();
         rx_stats.doneWait();
       } else if (expected) {
@@ -1433,11 +1426,21 @@ struct IOUringRunner : public RunnerBase {
 
       int cqe_count = 0;
       unsigned int head;
+      NETBENCH_TRACE(batch_start);
       io_uring_for_each_cqe(&ring, head, cqe) {
         processCqe(cqe, reads);
         cqe_count++;
       }
       io_uring_cq_advance(&ring, cqe_count);
+      NETBENCH_TRACE1(batch_end, cqe_count);
+      if (cqe_count >= kLongCqeBatch) {
+        rxEvent(RxEvent::LongCqeBatch, cqe_count);
+      }
+
+      if (TSock::kUseBufferProviderVersion) {
+        rearmStarved();
+        buffers_.maybeShrink(&ring, [this] { return get_sqe(); });
+      }
 
       if (!cqe_count && stopping) {
         vlog("processed ", cqe_count, " socks()=", socks());
@@ -1447,6 +1450,20 @@ struct IOUringRunner : public RunnerBase {
         rx_stats.doneLoop(bytesRx_, requestsRx_, reads, was_overflow);
       }
     }
+
+    if (enobuffCount_ || rxCfg_.provided_buffer_max_groups > 1 ||
+        rxCfg_.provided_buffer_classes.size() > 1) {
+      log(name(), ": provided buffers", buffers_.toString());
+    }
+    if (rxCfg_.max_sends_in_flight) {
+      log(name(),
+          ": send limit deferred_responses=",
+          deferredResponses_,
+          " aggregated_sends=",
+          aggregatedSends_,
+          " max_deferred_bytes=",
+          maxDeferredBytes_);
+    }
   }
 
   void stop() override {
@@ -1489,21 +1506,42 @@ struct IOUringRunner : public RunnerBase {
   }
 
   bool isFixedFiles() const {
+    if constexpr (TSock::kSpecialized) {
+      return TSock::kFlags & kFixedFilesFlag;
+    }
     return rxCfg_.fixed_files;
   }
 
+  bool cqeSkipSuccess() const {
+    if constexpr (TSock::kSpecialized) {
+      return TSock::kFlags & kCqeSkipSuccessFlag;
+    }
+    return rxCfg_.cqe_skip_success_flag;
+  }
+
   Config cfg_;
   IoUringRxConfig rxCfg_;
   int expected = 0;
   bool stopping = false;
   struct io_uring ring;
 
-  typename TSock::TBufferProvider buffers_;
+  typename TSock::TBufferPool buffers_;
   std::vector<std::unique_ptr<ListenSock>> listenSocks_;
-  std::vector<unsigned char> sendBuff_;
+  Buffer sendBuff_;
+  std::vector<Buffer> retiredSendBuffs_;
   int listeners_ = 0;
   uint32_t enobuffCount_ = 0;
+  // max_sends_in_flight: responses held back, and the sends that later went
+  // out with them
+  size_t deferredResponses_ = 0;
+  size_t aggregatedSends_ = 0;
+  size_t maxDeferredBytes_ = 0;
+  // sockets with no read armed after running out of buffers
+  std::vector<TSock*> needsRearm_;
   std::vector<int> acceptFdPool_;
+  // sends in flight pointing into each provided buffer, only in echo mode
+  std::vector<uint16_t> echoRefs_;
+  std::vector<EchoSend*> freeEchoSends_;
 };
 
 static constexpr uint32_t kSocket = 0;
@@ -1515,7 +1553,28 @@ struct EPollData {
   int fd;
   size_t to_write = 0;
   bool write_in_epoll = false;
+  // not reading until to_write drops below max_to_write
+  bool read_paused = false;
+  // the peer half closed, so close once to_write is sent
+  bool read_done = false;
+  // EPOLLIN is in the interest mask, off while paused or once read_done
+  bool read_in_epoll = true;
   ProtocolParser parser;
+  SocketTimestamps ts;
+  // echo mode: the last to_write bytes of this still need sending
+  std::vector<char> echo;
+  // requests waiting on to_write, for residence time
+  uint32_t pending_requests = 0;
+  std::chrono::steady_clock::time_point parsed_at;
+  // zerocopy_recv: receive queue pages are mapped here
+  void* zc_map = nullptr;
+  size_t zc_len = 0;
+
+  ~EPollData() {
+    if (zc_map) {
+      munmap(zc_map, zc_len);
+    }
+  }
 };
 
 struct EPollRunner : public RunnerBase {
@@ -1525,7 +1584,7 @@ struct EPollRunner : public RunnerBase {
       std::string const& name)
       : RunnerBase(name), cfg_(cfg), rxCfg_(rx_cfg) {
     epoll_fd = checkedErrno(epoll_create(rx_cfg.max_events), "epoll_create");
-    rcvbuff.resize(rx_cfg.recv_size);
+    rcvbuff = Buffer(rx_cfg.recv_size, rx_cfg.buffers);
     events.resize(rx_cfg.max_events);
 
     memset(&recvmsgHdr_, 0, sizeof(recvmsgHdr_));
@@ -1534,6 +1593,9 @@ struct EPollRunner : public RunnerBase {
     recvmsgHdr_.msg_iovlen = 1;
     recvmsgHdrIoVec_.iov_base = rcvbuff.data();
     recvmsgHdrIoVec_.iov_len = rcvbuff.size();
+    if (rx_cfg.timestamping) {
+      recvmsgHdr_.msg_control = control_.data();
+    }
   }
 
   ~EPollRunner() {
@@ -1569,7 +1631,7 @@ struct EPollRunner : public RunnerBase {
       unsigned int& reads) {
     if (events & EPOLLIN) {
       reads++;
-      if (doRead(ed)) {
+      if (doRead(ed, events & EPOLLRDHUP)) {
         return;
       }
     }
@@ -1580,15 +1642,25 @@ struct EPollRunner : public RunnerBase {
     }
   }
 
+  // closes the socket once everything is sent if the peer half closed, so
+  // ed must not be used after
   void doWrite(EPollData* ed) {
     int res;
 
     while (ed->to_write) {
-      res = send(
-          ed->fd,
-          rcvbuff.data(),
-          std::min<size_t>(ed->to_write, rcvbuff.size()),
-          MSG_NOSIGNAL);
+      if (rxCfg_.echo) {
+        res = send(
+            ed->fd,
+            ed->echo.data() + ed->echo.size() - ed->to_write,
+            ed->to_write,
+            MSG_NOSIGNAL);
+      } else {
+        res = send(
+            ed->fd,
+            rcvbuff.data(),
+            std::min<size_t>(ed->to_write, rcvbuff.size()),
+            MSG_NOSIGNAL);
+      }
       if (res < 0 && errno == EAGAIN) {
         break;
       }
@@ -1596,36 +1668,184 @@ struct EPollRunner : public RunnerBase {
         // something went wrong - probably socket is dead
         ed->to_write = 0;
       } else {
+        NETBENCH_TRACE1(send_queued, res);
         ed->to_write -= std::min<uint32_t>(ed->to_write, res);
+        if (rxCfg_.timestamping) {
+          ed->ts.sent(res);
+        }
       }
     }
 
-    if (ed->write_in_epoll && !ed->to_write) {
+    if (rxCfg_.timestamping) {
+      ed->ts.drainErrQueue(ed->fd, timestamps_);
+    }
+
+    if (!ed->to_write) {
+      ed->echo.clear();
+    }
+
+    if (ed->pending_requests && !ed->to_write) {
+      finishedResidence(ed->parsed_at, ed->pending_requests);
+      ed->pending_requests = 0;
+    }
+
+    if (ed->read_done && !ed->to_write) {
+      closeSock(ed, 0, 0);
+      return;
+    }
+
+    bool const want_write = ed->to_write;
+    bool const pause_read =
+        rxCfg_.max_to_write && ed->to_write >= rxCfg_.max_to_write;
+    // nothing more to read after a half close, and a level EPOLLIN would
+    // report the EOF on every wait until the responses are out
+    bool const want_read = !pause_read && !ed->read_done;
+    if (want_write != ed->write_in_epoll || want_read != ed->read_in_epoll) {
       struct epoll_event ev;
       memset(&ev, 0, sizeof(ev));
-      ev.events = EPOLLIN;
+      ev.events = EPOLLET | EPOLLRDHUP | (want_read ? EPOLLIN : 0) |
+          (want_write ? EPOLLOUT : 0);
       ev.data.ptr = ed;
       checkedErrno(
           epoll_ctl(epoll_fd, EPOLL_CTL_MOD, ed->fd, &ev),
-          "epoll_remove_write");
-      ed->write_in_epoll = false;
-    } else if (!ed->write_in_epoll && ed->to_write) {
-      struct epoll_event ev;
-      memset(&ev, 0, sizeof(ev));
-      ev.events = EPOLLIN | EPOLLOUT;
-      ev.data.ptr = ed;
-      checkedErrno(
-          epoll_ctl(epoll_fd, EPOLL_CTL_MOD, ed->fd, &ev), "epoll_add_write");
-      ed->write_in_epoll = true;
+          want_write ? "epoll_add_write" : "epoll_remove_write");
+      ed->write_in_epoll = want_write;
+      ed->read_in_epoll = want_read;
+    }
+    if (pause_read && !ed->read_paused) {
+      ++readPauses_;
+    }
+    ed->read_paused = pause_read;
+  }
+
+  // sockets are edge triggered, so a FIN that came with the last of the data
+  // is only noticed by reading on to the end when the peer has closed
+  int doRead(EPollData* ed, bool peer_closed) {
+    if (rxCfg_.zerocopy_recv) {
+      int res = doZerocopyRead(ed);
+      return res || !peer_closed ? res : doCopyRead(ed, true);
+    }
+    return doCopyRead(ed, peer_closed);
+  }
+
+  void closeSock(EPollData* ed, int res, int errnum) {
+    int fd = ed->fd;
+    checkedErrno(
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL),
+        "epoll_del fd=",
+        fd,
+        " res=",
+        res,
+        " errno=",
+        errnum);
+    delSock();
+    close(fd);
+    sockets_.erase(ed);
+    delete ed;
+  }
+
+  void consumeData(EPollData* ed, char const* data, size_t n) {
+    didRead(n);
+    ConsumeResults consumed;
+    if (rxCfg_.echo) {
+      consumed =
+          ed->parser.consume(data, n, [ed](char const* payload, size_t len) {
+            ed->echo.insert(ed->echo.end(), payload, payload + len);
+            ed->to_write += len;
+          });
+      consumed.to_write = 0;
+    } else {
+      consumed = ed->parser.consume(data, n);
+    }
+    if (rxCfg_.residence_time && consumed.count) {
+      if (!ed->pending_requests) {
+        ed->parsed_at = std::chrono::steady_clock::now();
+      }
+      ed->pending_requests += consumed.count;
+    }
+    runWorkload(rxCfg_, consumed.count);
+    finishedRequests(consumed.count);
+    ed->to_write += consumed.to_write;
+  }
+
+  // TCP_ZEROCOPY_RECEIVE maps whole pages of the receive queue into the
+  // socket's mapping instead of copying them. small reads get copied into
+  // rcvbuff by the kernel, and an unaligned tail is left for a normal recv
+  int doZerocopyRead(EPollData* ed) {
+    using namespace std::chrono;
+    while (true) {
+      struct tcp_zerocopy_receive zc;
+      memset(&zc, 0, sizeof(zc));
+      zc.address = (uint64_t)ed->zc_map;
+      zc.length = ed->zc_len;
+      zc.copybuf_address = (uint64_t)rcvbuff.data();
+      zc.copybuf_len = rcvbuff.size();
+      socklen_t zc_len = sizeof(zc);
+      auto const start = steady_clock::now();
+      int res =
+          getsockopt(ed->fd, IPPROTO_TCP, TCP_ZEROCOPY_RECEIVE, &zc, &zc_len);
+      auto const took = steady_clock::now() - start;
+      // older kernels know less of the struct and shrink zc_len to what they
+      // filled in. past that are still the values passed in
+      using Zc = struct tcp_zerocopy_receive;
+      bool const has_err = zc_len >= offsetof(Zc, err) + sizeof(zc.err);
+      bool const has_copybuf =
+          zc_len >= offsetof(Zc, copybuf_len) + sizeof(zc.copybuf_len);
+      if (res < 0 || (has_err && zc.err)) {
+        // let the normal path report whatever is wrong
+        return doCopyRead(ed);
+      }
+      // one call can both map and copy, so its time is split by bytes
+      uint64_t const copied =
+          has_copybuf && zc.copybuf_len > 0 ? zc.copybuf_len : 0;
+      if (uint64_t const total = zc.length + copied) {
+        auto const map_took = took * zc.length / total;
+        zcStats_.map_time += map_took;
+        zcStats_.copy_time += took - map_took;
+      }
+      if (zc.length) {
+        zcStats_.mapped += zc.length;
+        consumeData(ed, (char const*)ed->zc_map, zc.length);
+      }
+      if (copied) {
+        zcStats_.copied += copied;
+        consumeData(ed, rcvbuff.data(), copied);
+      }
+      size_t skip = zc.recv_skip_hint;
+      while (skip) {
+        auto const copy_start = steady_clock::now();
+        ssize_t got = recv(
+            ed->fd,
+            rcvbuff.data(),
+            std::min(skip, rcvbuff.size()),
+            MSG_NOSIGNAL);
+        if (got <= 0) {
+          return doCopyRead(ed);
+        }
+        zcStats_.copied += got;
+        zcStats_.copy_time += steady_clock::now() - copy_start;
+        consumeData(ed, rcvbuff.data(), got);
+        skip -= got;
+      }
+      if (!zc.length && !copied && !zc.recv_skip_hint) {
+        // nothing queued. recv tells apart EAGAIN and a closed socket
+        return doCopyRead(ed);
+      }
     }
   }
 
-  int doRead(EPollData* ed) {
+  int doCopyRead(EPollData* ed, bool peer_closed = false) {
     int res;
     int fd = ed->fd;
     do {
       if (rxCfg_.recvmsg) {
+        if (rxCfg_.timestamping) {
+          recvmsgHdr_.msg_controllen = control_.size();
+        }
         res = recvmsg(fd, &recvmsgHdr_, MSG_NOSIGNAL);
+        if (res > 0 && rxCfg_.timestamping) {
+          SocketTimestamps::readRx(&recvmsgHdr_, timestamps_);
+        }
       } else {
         res = recv(fd, rcvbuff.data(), rcvbuff.size(), MSG_NOSIGNAL);
       }
@@ -1634,175 +1854,1404 @@ struct EPollRunner : public RunnerBase {
         if (res < 0 && errnum == EAGAIN) {
           return 0;
         }
+        if (res == 0 && ed->to_write) {
+          // only half closed, so the responses still go back first
+          ed->read_done = true;
+          doWrite(ed);
+          return -1;
+        }
+        closeSock(ed, res, errnum);
+        return -1;
+      } else {
+        consumeData(ed, rcvbuff.data(), res);
+      }
+    } while (res == (int)rcvbuff.size() || peer_closed);
+    return 0;
+  }
+
+  void doAccept(int fd, bool isv6) {
+    struct sockaddr_in addr;
+    struct sockaddr_in6 addr6;
+    socklen_t addrlen = isv6 ? sizeof(addr6) : sizeof(addr);
+    struct sockaddr* paddr =
+        isv6 ? (struct sockaddr*)&addr6 : (struct sockaddr*)&addr;
+    while (true) {
+      int sock_fd = accept4(fd, paddr, &addrlen, SOCK_NONBLOCK);
+      if (sock_fd == -1 && errno == EAGAIN) {
+        break;
+      } else if (sock_fd == -1) {
+        checkedErrno(sock_fd, "accept4");
+      }
+      NETBENCH_TRACE1(accept, sock_fd);
+      if (rxCfg_.timestamping) {
+        SocketTimestamps::enable(sock_fd);
+      }
+      struct epoll_event ev;
+      memset(&ev, 0, sizeof(ev));
+      ev.events = EPOLLIN | EPOLLET | EPOLLRDHUP;
+      EPollData* ed = new EPollData();
+      ed->type = kSocket;
+      ed->fd = sock_fd;
+      if (rxCfg_.zerocopy_recv) {
+        ed->zc_len = zcMapSize_;
+        ed->zc_map = mmap(NULL, ed->zc_len, PROT_READ, MAP_SHARED, sock_fd, 0);
+        if (ed->zc_map == MAP_FAILED) {
+          ed->zc_map = nullptr;
+          die("zerocopy_recv mmap failed: ", strerror(errno));
+        }
+      }
+      ev.data.ptr = ed;
+      checkedErrno(
+          epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock_fd, &ev), "epoll add sock");
+      sockets_.insert(ed);
+      newSock();
+    }
+  }
+
+  void stop() override {}
+
+  void loop(std::atomic<bool>* should_shutdown) override {
+    RxStats rx_stats{name(), cfg_.print_read_stats, rxSeries(cfg_)};
+    std::vector<EPollData*> write_queue;
+    write_queue.reserve(1024);
+    while (!should_shutdown->load() && !globalShouldShutdown.load()) {
+      rx_stats.startWait();
+      int nevents = checkedErrno(
+          epoll_wait(epoll_fd, events.data(), events.size(), 1000),
+          "epoll_wait");
+      rx_stats.doneWait();
+      if (!nevents) {
+        vlog("epoll: no events socks()=", socks());
+      }
+      unsigned int reads = 0;
+      NETBENCH_TRACE(batch_start);
+      for (int i = 0; i < nevents; ++i) {
+        EPollData* ed = (EPollData*)events[i].data.ptr;
+        switch (ed->type) {
+          case kAccept4:
+            doAccept(ed->fd, false);
+            break;
+          case kAccept6:
+            doAccept(ed->fd, true);
+            break;
+          default:
+            doSocket(ed, events[i].events, write_queue, reads);
+            break;
+        }
+      }
+
+      for (auto* ed : write_queue) {
+        if (!sockets_.count(ed) || !ed->to_write) {
+          continue;
+        }
+        doWrite(ed);
+      }
+      write_queue.clear();
+      NETBENCH_TRACE1(batch_end, nevents);
+      if (cfg_.print_rx_stats) {
+        rx_stats.doneLoop(bytesRx_, requestsRx_, reads);
+      }
+    }
+
+    vlog("epollrunner: done socks=", socks());
+    if (rxCfg_.zerocopy_recv) {
+      logZerocopyStats();
+    }
+    if (rxCfg_.max_to_write) {
+      log(name(), ": max_to_write read_pauses=", readPauses_);
+    }
+  }
+
+  void logZerocopyStats() const {
+    using namespace std::chrono;
+    auto us_per_mb = [](steady_clock::duration d, size_t bytes) {
+      return bytes ? duration_cast<microseconds>(d).count() * 1000000.0 / bytes
+                   : 0.0;
+    };
+    log(name(),
+        ": zerocopy_recv mapped=",
+        zcStats_.mapped / 1000000,
+        "MB (copy avoided) copied=",
+        zcStats_.copied / 1000000,
+        "MB map_us_per_mb=",
+        us_per_mb(zcStats_.map_time, zcStats_.mapped),
+        " copy_us_per_mb=",
+        us_per_mb(zcStats_.copy_time, zcStats_.copied));
+  }
+
+  Config const cfg_;
+  EpollRxConfig const rxCfg_;
+  int epoll_fd;
+  std::vector<struct epoll_event> events;
+  Buffer rcvbuff;
+  std::vector<std::unique_ptr<EPollData>> listeners_;
+  std::unordered_set<EPollData*> sockets_;
+  struct msghdr recvmsgHdr_;
+  struct iovec recvmsgHdrIoVec_;
+  std::array<char, SocketTimestamps::kControlSize> control_;
+
+  struct ZerocopyStats {
+    size_t mapped = 0;
+    size_t copied = 0;
+    std::chrono::steady_clock::duration map_time{0};
+    std::chrono::steady_clock::duration copy_time{0};
+  };
+  size_t const zcMapSize_ =
+      (rxCfg_.recv_size + getpagesize() - 1) & ~(size_t)(getpagesize() - 1);
+  ZerocopyStats zcStats_;
+  // times a socket stopped being read for max_to_write
+  size_t readPauses_ = 0;
+};
+
+uint16_t pickPort(Config const& config) {
+  static uint16_t startPort =
+      config.use_port.size() ? config.use_port[0] : 10000 + rand() % 2000;
+  bool v6 = config.send_options.ipv6;
+  if (config.use_port.size()) {
+    return startPort++;
+  }
+  for (int i = 0; i < 1000; i++) {
+    auto port = startPort++;
+    if (v6) {
+      int v6 = mkBoundSock(port, true);
+      if (v6 < 0) {
+        continue;
+      }
+      close(v6);
+    } else {
+      int v4 = mkBoundSock(port, false);
+      if (v4 < 0) {
+        continue;
+      }
+      close(v4);
+    }
+    return port;
+  }
+  die("no port found");
+  return 0;
+}
+
+void run(std::unique_ptr<RunnerBase> runner, std::atomic<bool>* shutdown) {
+  try {
+    runner->start();
+    runner->startCpuAccounting();
+    runner->loop(shutdown);
+    runner->logSummary();
+  } catch (InterruptedException const&) {
+    vlog("interrupted, cleaning up nicely");
+    runner->stop();
+    vlog("waiting until done:");
+    runner->loop(shutdown);
+    runner->logSummary();
+    vlog("done");
+  } catch (std::exception const& ex) {
+    log("caught exception, terminating: ", ex.what());
+    throw;
+  }
+}
+
+struct Receiver {
+  std::unique_ptr<RunnerBase> r;
+  uint16_t port;
+  std::string name;
+  std::string rxCfg;
+};
+
+// splice_sink: received data is spliced into a pipe and from there into
+// /dev/null, so it never reaches user space. it is not parsed either, so only
+// bytes are counted. meant for streaming, as nothing is ever sent back
+class SpliceSinkBase : public RunnerBase {
+ public:
+  SpliceSinkBase(Config const& cfg, RxConfig const& rx_cfg, std::string const& name)
+      : RunnerBase(name), cfg_(cfg), recvSize_(rx_cfg.recv_size) {
+    devNull_ = checkedErrno(open("/dev/null", O_WRONLY), "open /dev/null");
+  }
+
+  ~SpliceSinkBase() override {
+    close(devNull_);
+  }
+
+ protected:
+  struct alignas(16) Sink {
+    int fd;
+    int pipe[2];
+    // bytes moved into the pipe but not yet out of it
+    size_t in_pipe = 0;
+  };
+
+  Sink* newSink(int fd) {
+    auto* s = new Sink{fd, {-1, -1}};
+    checkedErrno(pipe2(s->pipe, O_NONBLOCK), "sink pipe");
+    newSock();
+    return s;
+  }
+
+  void deleteSink(Sink* s) {
+    close(s->fd);
+    close(s->pipe[0]);
+    close(s->pipe[1]);
+    delete s;
+    delSock();
+  }
+
+  Config const cfg_;
+  size_t const recvSize_;
+  int devNull_;
+};
+
+class EPollSpliceSinkRunner : public SpliceSinkBase {
+ public:
+  EPollSpliceSinkRunner(
+      Config const& cfg,
+      RxConfig const& rx_cfg,
+      std::string const& name)
+      : SpliceSinkBase(cfg, rx_cfg, name) {
+    epollFd_ = checkedErrno(epoll_create(rx_cfg.max_events), "epoll_create");
+    events_.resize(rx_cfg.max_events);
+  }
+
+  ~EPollSpliceSinkRunner() override {
+    for (auto* s : sinks_) {
+      deleteSink(s);
+    }
+    for (int fd : listeners_) {
+      close(fd);
+    }
+    close(epollFd_);
+  }
+
+  void addListenSock(int fd, bool) override {
+    listeners_.push_back(fd);
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    // sinks are heap pointers, so never this small
+    ev.data.u64 = listeners_.size();
+    checkedErrno(epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev), "sink listen");
+  }
+
+  void stop() override {}
+
+  void loop(std::atomic<bool>* should_shutdown) override {
+    RxStats rx_stats{name(), cfg_.print_read_stats, rxSeries(cfg_)};
+    while (!should_shutdown->load() && !globalShouldShutdown.load()) {
+      rx_stats.startWait();
+      int nevents = checkedErrno(
+          epoll_wait(epollFd_, events_.data(), events_.size(), 1000),
+          "sink epoll_wait");
+      rx_stats.doneWait();
+      unsigned int reads = 0;
+      for (int i = 0; i < nevents; ++i) {
+        uint64_t const data = events_[i].data.u64;
+        if (data <= listeners_.size()) {
+          doAccept(listeners_[data - 1]);
+        } else {
+          reads++;
+          drain((Sink*)events_[i].data.ptr);
+        }
+      }
+      if (cfg_.print_rx_stats) {
+        rx_stats.doneLoop(bytesRx_, requestsRx_, reads);
+      }
+    }
+  }
+
+ private:
+  void doAccept(int fd) {
+    while (true) {
+      int sock_fd = accept4(fd, NULL, NULL, SOCK_NONBLOCK);
+      if (sock_fd == -1 && errno == EAGAIN) {
+        break;
+      } else if (sock_fd == -1) {
+        checkedErrno(sock_fd, "sink accept4");
+      }
+      Sink* s = newSink(sock_fd);
+      struct epoll_event ev;
+      memset(&ev, 0, sizeof(ev));
+      ev.events = EPOLLIN | EPOLLET;
+      ev.data.ptr = s;
+      checkedErrno(
+          epoll_ctl(epollFd_, EPOLL_CTL_ADD, sock_fd, &ev), "sink add sock");
+      sinks_.insert(s);
+    }
+  }
+
+  void drain(Sink* s) {
+    while (true) {
+      ssize_t got = splice(
+          s->fd,
+          NULL,
+          s->pipe[1],
+          NULL,
+          recvSize_,
+          SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if (got < 0 && errno == EAGAIN) {
+        return;
+      } else if (got <= 0) {
+        epoll_ctl(epollFd_, EPOLL_CTL_DEL, s->fd, NULL);
+        sinks_.erase(s);
+        deleteSink(s);
+        return;
+      }
+      didRead(got);
+      while (got > 0) {
+        // /dev/null never pushes back
+        got -= checkedErrno(
+            splice(s->pipe[0], NULL, devNull_, NULL, got, SPLICE_F_MOVE),
+            "sink splice out");
+      }
+    }
+  }
+
+  int epollFd_;
+  std::vector<struct epoll_event> events_;
+  std::vector<int> listeners_;
+  std::unordered_set<Sink*> sinks_;
+};
+
+// as above with IORING_OP_SPLICE. io_uring punts splices to its workers, so
+// each socket has one splice in flight, alternating into and out of the pipe
+class IOUringSpliceSinkRunner : public SpliceSinkBase {
+ public:
+  IOUringSpliceSinkRunner(
+      Config const& cfg,
+      IoUringRxConfig const& rx_cfg,
+      struct io_uring r,
+      std::string const& name)
+      : SpliceSinkBase(cfg, rx_cfg, name),
+        ring_(r),
+        deferTaskrun_(rx_cfg.defer_taskrun) {}
+
+  ~IOUringSpliceSinkRunner() override {
+    io_uring_queue_exit(&ring_);
+    for (auto* s : sinks_) {
+      deleteSink(s);
+    }
+    for (int fd : listeners_) {
+      close(fd);
+    }
+  }
+
+  void addListenSock(int fd, bool) override {
+    listeners_.push_back(fd);
+    addAccept(fd);
+  }
+
+  void stop() override {
+    stopping_ = true;
+  }
+
+  void loop(std::atomic<bool>* should_shutdown) override {
+    RxStats rx_stats{name(), cfg_.print_read_stats, rxSeries(cfg_)};
+    struct __kernel_timespec timeout;
+    timeout.tv_sec = 1;
+    timeout.tv_nsec = 0;
+    if (deferTaskrun_) {
+      // set up disabled so that this thread can be the single issuer
+      io_uring_enable_rings(&ring_);
+    }
+    while (!should_shutdown->load() && !globalShouldShutdown.load()) {
+      struct io_uring_cqe* cqe = nullptr;
+      unsigned int reads = 0;
+      rx_stats.startWait();
+      checkedErrno(
+          io_uring_submit_and_wait_timeout(&ring_, &cqe, 1, &timeout, NULL),
+          "sink submit_and_wait_timeout");
+      rx_stats.doneWait();
+      int cqe_count = 0;
+      unsigned int head;
+      io_uring_for_each_cqe(&ring_, head, cqe) {
+        processCqe(cqe, reads);
+        cqe_count++;
+      }
+      io_uring_cq_advance(&ring_, cqe_count);
+      if (cfg_.print_rx_stats) {
+        rx_stats.doneLoop(bytesRx_, requestsRx_, reads);
+      }
+    }
+  }
+
+ private:
+  static constexpr uint64_t kAccept = 1;
+  static constexpr uint64_t kSpliceIn = 2;
+  static constexpr uint64_t kSpliceOut = 3;
+  static constexpr uint64_t kPollIn = 4;
+
+  struct io_uring_sqe* getSqe() {
+    struct io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+    if (!sqe) {
+      io_uring_submit(&ring_);
+      sqe = io_uring_get_sqe(&ring_);
+      if (!sqe) {
+        die("sink: no sqe available");
+      }
+    }
+    return sqe;
+  }
+
+  void addAccept(int fd) {
+    auto* sqe = getSqe();
+    io_uring_prep_accept(sqe, fd, NULL, NULL, SOCK_NONBLOCK);
+    io_uring_sqe_set_data64(sqe, ((uint64_t)fd << 4) | kAccept);
+  }
+
+  void addSpliceIn(Sink* s) {
+    auto* sqe = getSqe();
+    io_uring_prep_splice(
+        sqe, s->fd, -1, s->pipe[1], -1, recvSize_, SPLICE_F_MOVE);
+    io_uring_sqe_set_data64(sqe, (uint64_t)s | kSpliceIn);
+  }
+
+  // the socket is non blocking, so an idle one needs waiting for
+  void addPollIn(Sink* s) {
+    auto* sqe = getSqe();
+    io_uring_prep_poll_add(sqe, s->fd, POLLIN);
+    io_uring_sqe_set_data64(sqe, (uint64_t)s | kPollIn);
+  }
+
+  void addSpliceOut(Sink* s) {
+    auto* sqe = getSqe();
+    io_uring_prep_splice(
+        sqe, s->pipe[0], -1, devNull_, -1, s->in_pipe, SPLICE_F_MOVE);
+    io_uring_sqe_set_data64(sqe, (uint64_t)s | kSpliceOut);
+  }
+
+  void closeSink(Sink* s) {
+    sinks_.erase(s);
+    deleteSink(s);
+  }
+
+  void processCqe(struct io_uring_cqe* cqe, unsigned int& reads) {
+    if (cqe->user_data == LIBURING_UDATA_TIMEOUT) {
+      return;
+    }
+    uint64_t const t = cqe->user_data & 0x0f;
+    if (t == kAccept) {
+      int const listen_fd = cqe->user_data >> 4;
+      if (cqe->res >= 0) {
+        Sink* s = newSink(cqe->res);
+        sinks_.insert(s);
+        addSpliceIn(s);
+      } else if (!stopping_) {
+        die("sink: unexpected accept result ", strerror(-cqe->res));
+      }
+      if (!stopping_) {
+        addAccept(listen_fd);
+      }
+      return;
+    }
+    Sink* s = (Sink*)(cqe->user_data & ~(uint64_t)0x0f);
+    if (t == kSpliceIn && cqe->res == -EAGAIN) {
+      addPollIn(s);
+      return;
+    }
+    if (cqe->res <= 0) {
+      closeSink(s);
+      return;
+    }
+    if (t == kPollIn) {
+      addSpliceIn(s);
+    } else if (t == kSpliceIn) {
+      reads++;
+      didRead(cqe->res);
+      s->in_pipe = cqe->res;
+      addSpliceOut(s);
+    } else if (t == kSpliceOut) {
+      s->in_pipe -= std::min<size_t>(s->in_pipe, cqe->res);
+      if (s->in_pipe) {
+        addSpliceOut(s);
+      } else {
+        addSpliceIn(s);
+      }
+    } else {
+      die("sink: unexpected completion:", cqe->user_data);
+    }
+  }
+
+  struct io_uring ring_;
+  bool const deferTaskrun_;
+  std::vector<int> listeners_;
+  std::unordered_set<Sink*> sinks_;
+  bool stopping_ = false;
+};
+
+Receiver makeEpollRx(Config const& cfg, EpollRxConfig const& rx_cfg) {
+  uint16_t port = pickPort(cfg);
+  std::unique_ptr<RunnerBase> runner;
+  if (rx_cfg.splice_sink) {
+    runner = std::make_unique<EPollSpliceSinkRunner>(
+        cfg, rx_cfg, strcat("epoll splice_sink port=", port));
+  } else {
+    runner =
+        std::make_unique<EPollRunner>(cfg, rx_cfg, strcat("epoll port=", port));
+  }
+  runner->addListenSock(
+      mkServerSock(rx_cfg, port, cfg.send_options.ipv6, SOCK_NONBLOCK),
+      cfg.send_options.ipv6);
+  return Receiver{std::move(runner), port, "epoll", rx_cfg.describe()};
+}
+
+// forwards bytes between client connections and a backend receiver.
+// subclasses decide how the bytes are moved
+class ProxyRunnerBase : public RunnerBase {
+ public:
+  ProxyRunnerBase(
+      Config const& cfg,
+      ProxyRxConfig const& rx_cfg,
+      std::string const& name,
+      std::unique_ptr<RunnerBase> local_backend)
+      : RunnerBase(name),
+        cfg_(cfg),
+        rxCfg_(rx_cfg),
+        localBackend_(std::move(local_backend)) {
+    getAddress(
+        rx_cfg.backend_host,
+        cfg.send_options.ipv6,
+        rx_cfg.backend_port,
+        &backendAddr_,
+        &backendAddrLen_);
+  }
+
+  ~ProxyRunnerBase() override {
+    stopBackend();
+  }
+
+  void start() override {
+    if (!localBackend_) {
+      return;
+    }
+    backendThread_ = std::thread(wrapThread(
+        "proxy_backend",
+        [this, r = std::move(localBackend_)]() mutable {
+          run(std::move(r), &backendShutdown_);
+        }));
+  }
+
+ protected:
+  // connection setup is not what is being measured, but a blocking connect
+  // would stall every other connection on the loop. so the runners connect
+  // this nonblocking socket to backendAddr() in the background
+  int backendSocket() {
+    return checkedErrno(
+        socket(
+            cfg_.send_options.ipv6 ? AF_INET6 : AF_INET,
+            SOCK_STREAM | SOCK_NONBLOCK,
+            0),
+        "proxy backend socket");
+  }
+
+  struct sockaddr const* backendAddr() const {
+    return (struct sockaddr const*)&backendAddr_;
+  }
+
+  socklen_t backendAddrLen() const {
+    return backendAddrLen_;
+  }
+
+  void startCpu() {
+    checkedErrno(getrusage(RUSAGE_THREAD, &cpuStart_), "getrusage");
+  }
+
+  void logCpu() {
+    struct rusage now;
+    checkedErrno(getrusage(RUSAGE_THREAD, &now), "getrusage");
+    auto us = [](struct timeval const& a, struct timeval const& b) {
+      return (b.tv_sec - a.tv_sec) * 1000000LL + (b.tv_usec - a.tv_usec);
+    };
+    int64_t user_us = us(cpuStart_.ru_utime, now.ru_utime);
+    int64_t sys_us = us(cpuStart_.ru_stime, now.ru_stime);
+    double ns_per_byte =
+        bytesRx_ ? ((user_us + sys_us) * 1000.0) / bytesRx_ : 0.0;
+    log(name(),
+        ": proxy strategy=",
+        rxCfg_.strategy,
+        " forwarded=",
+        bytesRx_ / 1000000,
+        "MB user=",
+        user_us / 1000,
+        "ms system=",
+        sys_us / 1000,
+        "ms cpu_ns_per_byte=",
+        ns_per_byte);
+  }
+
+  void stopBackend() {
+    backendShutdown_ = true;
+    if (backendThread_.joinable()) {
+      backendThread_.join();
+    }
+  }
+
+  Config const cfg_;
+  ProxyRxConfig const rxCfg_;
+
+ private:
+  struct sockaddr_storage backendAddr_;
+  socklen_t backendAddrLen_;
+  std::unique_ptr<RunnerBase> localBackend_;
+  std::thread backendThread_;
+  std::atomic<bool> backendShutdown_{false};
+  struct rusage cpuStart_;
+};
+
+// copy and splice strategies, driven by level triggered epoll
+class EPollProxyRunner : public ProxyRunnerBase {
+ public:
+  EPollProxyRunner(
+      Config const& cfg,
+      ProxyRxConfig const& rx_cfg,
+      std::string const& name,
+      std::unique_ptr<RunnerBase> local_backend)
+      : ProxyRunnerBase(cfg, rx_cfg, name, std::move(local_backend)),
+        splice_(rx_cfg.strategy == "splice") {
+    epollFd_ = checkedErrno(epoll_create(rx_cfg.max_events), "epoll_create");
+    events_.resize(rx_cfg.max_events);
+  }
+
+  ~EPollProxyRunner() override {
+    for (auto* c : conns_) {
+      closeConn(c);
+    }
+    reap();
+    for (auto& l : listeners_) {
+      close(l.fd);
+    }
+    close(epollFd_);
+  }
+
+  void addListenSock(int fd, bool) override {
+    listeners_.emplace_back();
+    Listener& l = listeners_.back();
+    l.fd = fd;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = &l;
+    checkedErrno(epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev), "proxy listen");
+  }
+
+  void stop() override {}
+
+  void loop(std::atomic<bool>* should_shutdown) override {
+    RxStats rx_stats{name(), cfg_.print_read_stats, rxSeries(cfg_)};
+    startCpu();
+    while (!should_shutdown->load() && !globalShouldShutdown.load()) {
+      rx_stats.startWait();
+      int nevents = checkedErrno(
+          epoll_wait(epollFd_, events_.data(), events_.size(), 1000),
+          "proxy epoll_wait");
+      rx_stats.doneWait();
+      unsigned int reads = 0;
+      for (int i = 0; i < nevents; ++i) {
+        auto* tagged = (Tagged*)events_[i].data.ptr;
+        if (tagged->listener) {
+          doAccept(tagged->fd);
+          continue;
+        }
+        auto* end = (End*)tagged;
+        Conn* c = end->conn;
+        if (c->dead) {
+          continue;
+        }
+        uint32_t const ev = events_[i].events;
+        if (c->connecting) {
+          if (end == &c->backend) {
+            finishConnect(c);
+          } else if (ev & EPOLLERR) {
+            closeConn(c);
+          }
+          continue;
+        }
+        Direction& in = end == &c->client ? c->up : c->down;
+        if ((ev & (EPOLLERR | EPOLLHUP)) && in.eof) {
+          // nothing more can be read, so these would be reported forever
+          closeConn(c);
+          continue;
+        }
+        if (ev & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+          reads++;
+          forward(c, in);
+        }
+        if (!c->dead && (ev & EPOLLOUT)) {
+          forward(c, end == &c->client ? c->down : c->up);
+        }
+      }
+      reap();
+      if (cfg_.print_rx_stats) {
+        rx_stats.doneLoop(bytesRx_, requestsRx_, reads);
+      }
+    }
+    logCpu();
+    stopBackend();
+  }
+
+ private:
+  struct Conn;
+
+  struct Tagged {
+    bool listener = false;
+    int fd = -1;
+  };
+
+  struct Listener : Tagged {
+    Listener() {
+      listener = true;
+    }
+  };
+
+  struct End : Tagged {
+    Conn* conn = nullptr;
+    uint32_t events = 0;
+  };
+
+  // one direction of bytes, either through a user buffer or a pipe
+  struct Direction {
+    End* from;
+    End* to;
+    std::vector<char> buff;
+    size_t at = 0;
+    size_t have = 0;
+    int pipe[2] = {-1, -1};
+    std::chrono::steady_clock::time_point since;
+    bool parse = false;
+    // from was closed for writing, and that has been passed on to
+    bool eof = false;
+  };
+
+  struct Conn {
+    End client;
+    End backend;
+    Direction up; // client -> backend
+    Direction down; // backend -> client
+    ProtocolParser parser;
+    // the client is not read from until the backend is connected
+    bool connecting = true;
+    bool dead = false;
+  };
+
+  void setupDirection(Direction& d, End* from, End* to, bool parse) {
+    d.from = from;
+    d.to = to;
+    d.parse = parse;
+    if (splice_) {
+      checkedErrno(pipe2(d.pipe, O_NONBLOCK), "proxy pipe");
+      if (rxCfg_.pipe_size > 0) {
+        checkedErrno(
+            fcntl(d.pipe[1], F_SETPIPE_SZ, rxCfg_.pipe_size), "pipe size");
+      }
+    } else {
+      d.buff.resize(rxCfg_.recv_size);
+    }
+  }
+
+  void addEnd(End& e, int fd, Conn* c, uint32_t events) {
+    e.fd = fd;
+    e.conn = c;
+    e.events = events;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = e.events;
+    ev.data.ptr = &e;
+    checkedErrno(epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev), "proxy add");
+  }
+
+  void doAccept(int fd) {
+    while (true) {
+      int sock_fd = accept4(fd, NULL, NULL, SOCK_NONBLOCK);
+      if (sock_fd == -1 && errno == EAGAIN) {
+        break;
+      } else if (sock_fd == -1) {
+        checkedErrno(sock_fd, "proxy accept4");
+      }
+      Conn* c = new Conn();
+      int backend_fd = backendSocket();
+      int res = ::connect(backend_fd, backendAddr(), backendAddrLen());
+      if (res < 0 && errno != EINPROGRESS) {
+        checkedErrno(res, "proxy backend connect");
+      }
+      addEnd(c->client, sock_fd, c, 0);
+      // writable once connected
+      addEnd(c->backend, backend_fd, c, EPOLLOUT);
+      // only requests are parsed, and only if the data is seen
+      setupDirection(c->up, &c->client, &c->backend, !splice_);
+      setupDirection(c->down, &c->backend, &c->client, false);
+      conns_.insert(c);
+      newSock();
+    }
+  }
+
+  void finishConnect(Conn* c) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    checkedErrno(
+        getsockopt(c->backend.fd, SOL_SOCKET, SO_ERROR, &err, &len),
+        "proxy backend connect");
+    if (err) {
+      die("proxy backend connect: ", strerror(err));
+    }
+    c->connecting = false;
+    setEvents(c->backend, EPOLLIN, EPOLLIN | EPOLLOUT);
+    setEvents(c->client, EPOLLIN, EPOLLIN);
+  }
+
+  // returns bytes read, 0 on close, -1 with errno set otherwise
+  ssize_t fill(Direction& d) {
+    if (splice_) {
+      return splice(
+          d.from->fd,
+          NULL,
+          d.pipe[1],
+          NULL,
+          rxCfg_.recv_size,
+          SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    }
+    return recv(d.from->fd, d.buff.data(), d.buff.size(), 0);
+  }
+
+  ssize_t drain(Direction& d) {
+    if (splice_) {
+      return splice(
+          d.pipe[0],
+          NULL,
+          d.to->fd,
+          NULL,
+          d.have,
+          SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    }
+    return send(d.to->fd, d.buff.data() + d.at, d.have, MSG_NOSIGNAL);
+  }
+
+  void forward(Conn* c, Direction& d) {
+    if (d.eof) {
+      return;
+    }
+    // bound the work per event so one connection cannot starve the rest
+    for (int i = 0; i < 16; i++) {
+      if (!d.have) {
+        ssize_t got = fill(d);
+        if (got == 0) {
+          finishDirection(c, d);
+          return;
+        } else if (got < 0 && errno != EAGAIN) {
+          closeConn(c);
+          return;
+        } else if (got < 0) {
+          break;
+        }
+        d.have = got;
+        d.at = 0;
+        if (rxCfg_.residence_time) {
+          d.since = std::chrono::steady_clock::now();
+        }
+        didRead(got);
+        if (d.parse) {
+          finishedRequests(c->parser.consume(d.buff.data(), got).count);
+        }
+      }
+      ssize_t sent = drain(d);
+      if (sent < 0 && errno != EAGAIN) {
+        closeConn(c);
+        return;
+      } else if (sent > 0) {
+        d.have -= sent;
+        d.at += sent;
+      }
+      if (d.have) {
+        break;
+      }
+      if (rxCfg_.residence_time) {
+        finishedResidence(d.since, 1);
+      }
+    }
+    // stop reading while there is data waiting for the other side
+    setEvents(*d.from, d.have ? 0 : EPOLLIN, EPOLLIN);
+    setEvents(*d.to, d.have ? EPOLLOUT : 0, EPOLLOUT);
+  }
+
+  // from closed for writing with everything it sent passed on, so pass the
+  // close on too. the other direction carries on until it closes as well
+  void finishDirection(Conn* c, Direction& d) {
+    d.eof = true;
+    shutdown(d.to->fd, SHUT_WR);
+    if (c->up.eof && c->down.eof) {
+      closeConn(c);
+      return;
+    }
+    setEvents(*d.from, 0, EPOLLIN);
+    setEvents(*d.to, 0, EPOLLOUT);
+  }
+
+  void setEvents(End& e, uint32_t set, uint32_t mask) {
+    uint32_t want = (e.events & ~mask) | set;
+    if (want == e.events) {
+      return;
+    }
+    e.events = want;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = want;
+    ev.data.ptr = &e;
+    checkedErrno(epoll_ctl(epollFd_, EPOLL_CTL_MOD, e.fd, &ev), "proxy mod");
+  }
+
+  void closeConn(Conn* c) {
+    if (c->dead) {
+      return;
+    }
+    c->dead = true;
+    for (End* e : {&c->client, &c->backend}) {
+      epoll_ctl(epollFd_, EPOLL_CTL_DEL, e->fd, NULL);
+      close(e->fd);
+    }
+    for (Direction* d : {&c->up, &c->down}) {
+      for (int p : d->pipe) {
+        if (p >= 0) {
+          close(p);
+        }
+      }
+    }
+    dead_.push_back(c);
+  }
 
-        checkedErrno(
-            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL),
-            "epoll_del fd=",
-            fd,
-            " res=",
-            res,
-            " errno=",
-            errnum);
-        delSock();
-        close(fd);
-        sockets_.erase(ed);
-        delete ed;
+  // other events in the same batch might point at closed connections
+  void reap() {
+    for (auto* c : dead_) {
+      conns_.erase(c);
+      delete c;
+      delSock();
+    }
+    dead_.clear();
+  }
 
-        return -1;
-      } else {
-        didRead(res);
-        auto consumed = ed->parser.consume(rcvbuff.data(), res);
-        runWorkload(rxCfg_, consumed.count);
-        finishedRequests(consumed.count);
-        ed->to_write += consumed.to_write;
-      }
-    } while (res == (int)rcvbuff.size());
-    return 0;
+  bool const splice_;
+  int epollFd_;
+  std::vector<struct epoll_event> events_;
+  std::deque<Listener> listeners_;
+  std::unordered_set<Conn*> conns_;
+  std::vector<Conn*> dead_;
+};
+
+// multishot recv into provided buffers, and each buffer is sent on to the
+// other side before it is recycled. a linked recv->send cannot be used as the
+// send length is only known once the recv completes
+class IOUringProxyRunner : public ProxyRunnerBase {
+ public:
+  IOUringProxyRunner(
+      Config const& cfg,
+      ProxyRxConfig const& rx_cfg,
+      IoUringRxConfig const& io_uring_cfg,
+      struct io_uring r,
+      std::string const& name,
+      std::unique_ptr<RunnerBase> local_backend)
+      : ProxyRunnerBase(cfg, rx_cfg, name, std::move(local_backend)),
+        ring_(r),
+        buffers_(io_uring_cfg) {
+    buffers_.initialRegister(&ring_);
   }
 
-  void doAccept(int fd, bool isv6) {
-    struct sockaddr_in addr;
-    struct sockaddr_in6 addr6;
-    socklen_t addrlen = isv6 ? sizeof(addr6) : sizeof(addr);
-    struct sockaddr* paddr =
-        isv6 ? (struct sockaddr*)&addr6 : (struct sockaddr*)&addr;
-    while (true) {
-      int sock_fd = accept4(fd, paddr, &addrlen, SOCK_NONBLOCK);
-      if (sock_fd == -1 && errno == EAGAIN) {
-        break;
-      } else if (sock_fd == -1) {
-        checkedErrno(sock_fd, "accept4");
+  ~IOUringProxyRunner() override {
+    io_uring_queue_exit(&ring_);
+    for (auto& l : listeners_) {
+      close(l.fd);
+    }
+    for (auto* c : conns_) {
+      if (!c->closing) {
+        closeFds(c);
       }
-      struct epoll_event ev;
-      memset(&ev, 0, sizeof(ev));
-      ev.events = EPOLLIN | EPOLLET;
-      EPollData* ed = new EPollData();
-      ed->type = kSocket;
-      ed->fd = sock_fd;
-      ev.data.ptr = ed;
-      checkedErrno(
-          epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock_fd, &ev), "epoll add sock");
-      sockets_.insert(ed);
-      newSock();
+      delete c;
     }
   }
 
-  void stop() override {}
+  void addListenSock(int fd, bool) override {
+    listeners_.emplace_back();
+    listeners_.back().fd = fd;
+    addAccept(&listeners_.back());
+  }
+
+  void stop() override {
+    stopping_ = true;
+  }
 
   void loop(std::atomic<bool>* should_shutdown) override {
-    RxStats rx_stats{name(), cfg_.print_read_stats};
-    std::vector<EPollData*> write_queue;
-    write_queue.reserve(1024);
+    RxStats rx_stats{name(), cfg_.print_read_stats, rxSeries(cfg_)};
+    struct __kernel_timespec timeout;
+    timeout.tv_sec = 1;
+    timeout.tv_nsec = 0;
+    startCpu();
     while (!should_shutdown->load() && !globalShouldShutdown.load()) {
+      struct io_uring_cqe* cqe = nullptr;
+      unsigned int reads = 0;
       rx_stats.startWait();
-      int nevents = checkedErrno(
-          epoll_wait(epoll_fd, events.data(), events.size(), 1000),
-          "epoll_wait");
+      checkedErrno(
+          io_uring_submit_and_wait_timeout(&ring_, &cqe, 1, &timeout, NULL),
+          "proxy submit_and_wait_timeout");
       rx_stats.doneWait();
-      if (!nevents) {
-        vlog("epoll: no events socks()=", socks());
+      int cqe_count = 0;
+      unsigned int head;
+      io_uring_for_each_cqe(&ring_, head, cqe) {
+        processCqe(cqe, reads);
+        cqe_count++;
       }
-      unsigned int reads = 0;
-      for (int i = 0; i < nevents; ++i) {
-        EPollData* ed = (EPollData*)events[i].data.ptr;
-        switch (ed->type) {
-          case kAccept4:
-            doAccept(ed->fd, false);
-            break;
-          case kAccept6:
-            doAccept(ed->fd, true);
-            break;
-          default:
-            doSocket(ed, events[i].events, write_queue, reads);
-            break;
-        }
+      io_uring_cq_advance(&ring_, cqe_count);
+      rearm();
+      if (cfg_.print_rx_stats) {
+        rx_stats.doneLoop(bytesRx_, requestsRx_, reads);
       }
+    }
+    stop();
+    logCpu();
+    stopBackend();
+  }
 
-      for (auto* ed : write_queue) {
-        if (!sockets_.count(ed) || !ed->to_write) {
-          continue;
+ private:
+  static constexpr int kAccept = 1;
+  static constexpr int kRecvUp = 2;
+  static constexpr int kRecvDown = 3;
+  static constexpr int kSendUp = 4;
+  static constexpr int kSendDown = 5;
+  static constexpr int kConnect = 6;
+
+  struct Listener {
+    int fd;
+  };
+
+  struct Chunk {
+    uint16_t bid;
+    uint32_t len;
+    std::chrono::steady_clock::time_point at;
+  };
+
+  struct Direction {
+    int from;
+    int to;
+    // sends are done one at a time to keep the byte stream in order
+    std::deque<Chunk> queue;
+    bool sending = false;
+    bool armed = false;
+    // from closed for writing, and once queue is sent so is to
+    bool eof = false;
+    bool shut = false;
+  };
+
+  struct alignas(16) Conn {
+    Direction up; // client -> backend
+    Direction down; // backend -> client
+    ProtocolParser parser;
+    int inflight = 0;
+    bool closing = false;
+  };
+
+  static void* tag(void* p, int t) {
+    return (void*)((uintptr_t)p | t);
+  }
+
+  template <class T>
+  static T* untag(uint64_t p) {
+    return (T*)(p & ~((uint64_t)0x0f));
+  }
+
+  static int getTag(uint64_t p) {
+    return (int)(p & 0x0f);
+  }
+
+  struct io_uring_sqe* getSqe() {
+    struct io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+    if (!sqe) {
+      io_uring_submit(&ring_);
+      sqe = io_uring_get_sqe(&ring_);
+      if (!sqe) {
+        die("proxy: no sqe available");
+      }
+    }
+    return sqe;
+  }
+
+  void addAccept(Listener* l) {
+    auto* sqe = getSqe();
+    io_uring_prep_accept(sqe, l->fd, NULL, NULL, SOCK_NONBLOCK);
+    io_uring_sqe_set_data(sqe, tag(l, kAccept));
+  }
+
+  void addRecv(Conn* c, bool up) {
+    Direction& d = up ? c->up : c->down;
+    auto* sqe = getSqe();
+    io_uring_prep_recv_multishot(sqe, d.from, NULL, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BufferProviderV2::kBgid;
+    io_uring_sqe_set_data(sqe, tag(c, up ? kRecvUp : kRecvDown));
+    d.armed = true;
+    c->inflight++;
+  }
+
+  void addConnect(Conn* c) {
+    auto* sqe = getSqe();
+    io_uring_prep_connect(sqe, c->up.to, backendAddr(), backendAddrLen());
+    io_uring_sqe_set_data(sqe, tag(c, kConnect));
+    c->inflight++;
+  }
+
+  void sendNext(Conn* c, bool up) {
+    Direction& d = up ? c->up : c->down;
+    if (d.sending || d.queue.empty() || c->closing) {
+      return;
+    }
+    Chunk const& ch = d.queue.front();
+    auto* sqe = getSqe();
+    io_uring_prep_send(
+        sqe, d.to, buffers_.getData(ch.bid), ch.len, MSG_WAITALL);
+    io_uring_sqe_set_data(sqe, tag(c, up ? kSendUp : kSendDown));
+    d.sending = true;
+    c->inflight++;
+  }
+
+  void processAccept(struct io_uring_cqe* cqe) {
+    Listener* l = untag<Listener>(cqe->user_data);
+    if (cqe->res >= 0) {
+      Conn* c = new Conn();
+      c->up.from = c->down.to = cqe->res;
+      c->up.to = c->down.from = backendSocket();
+      conns_.insert(c);
+      newSock();
+      // the client is not read from until the backend is connected
+      addConnect(c);
+    } else if (!stopping_) {
+      die("proxy: unexpected accept result ", strerror(-cqe->res));
+    }
+    if (!stopping_) {
+      addAccept(l);
+    }
+  }
+
+  void processConnect(struct io_uring_cqe* cqe) {
+    Conn* c = untag<Conn>(cqe->user_data);
+    c->inflight--;
+    if (cqe->res < 0 && !c->closing && !stopping_) {
+      die("proxy backend connect: ", strerror(-cqe->res));
+    } else if (!c->closing) {
+      addRecv(c, true);
+      addRecv(c, false);
+    }
+    maybeDelete(c);
+  }
+
+  void processRecv(struct io_uring_cqe* cqe, bool up) {
+    Conn* c = untag<Conn>(cqe->user_data);
+    Direction& d = up ? c->up : c->down;
+    bool const more = cqe->flags & IORING_CQE_F_MORE;
+    if (!more) {
+      c->inflight--;
+      d.armed = false;
+    }
+    int bid = providedBufferIdx(cqe);
+    bool starved = false;
+    if (cqe->res > 0 && bid >= 0) {
+      ++inUse_;
+      if (c->closing) {
+        recycle(bid);
+      } else {
+        didRead(cqe->res);
+        if (up) {
+          finishedRequests(
+              c->parser.consume(buffers_.getData(bid), cqe->res).count);
         }
-        doWrite(ed);
+        d.queue.push_back(Chunk{
+            (uint16_t)bid,
+            (uint32_t)cqe->res,
+            rxCfg_.residence_time ? std::chrono::steady_clock::now()
+                                  : std::chrono::steady_clock::time_point{}});
+        sendNext(c, up);
       }
-      write_queue.clear();
-      if (cfg_.print_rx_stats) {
-        rx_stats.doneLoop(bytesRx_, requestsRx_, reads);
+    } else if (cqe->res == -ENOBUFS) {
+      // wait for buffers to come back before asking again
+      ++enobufs_;
+      starved = true;
+    } else if (cqe->res == 0) {
+      // the other direction carries on until it closes as well
+      d.eof = true;
+      shutdownWhenSent(c, d);
+    } else if (cqe->res < 0) {
+      closeConn(c);
+    }
+    if (!more && !d.armed && !d.eof && !c->closing) {
+      (starved ? starved_ : needsRearm_).emplace_back(c, up);
+    }
+    maybeDelete(c);
+  }
+
+  void processSend(struct io_uring_cqe* cqe, bool up) {
+    Conn* c = untag<Conn>(cqe->user_data);
+    Direction& d = up ? c->up : c->down;
+    c->inflight--;
+    d.sending = false;
+    if (!d.queue.empty()) {
+      Chunk ch = d.queue.front();
+      d.queue.pop_front();
+      if (rxCfg_.residence_time) {
+        finishedResidence(ch.at, 1);
       }
+      recycle(ch.bid);
+    }
+    if (cqe->res < 0) {
+      closeConn(c);
+    } else {
+      sendNext(c, up);
+      shutdownWhenSent(c, d);
     }
+    maybeDelete(c);
+  }
 
-    vlog("epollrunner: done socks=", socks());
+  // pass a close for writing on once everything before it has been sent, and
+  // close when both directions are done
+  void shutdownWhenSent(Conn* c, Direction& d) {
+    if (!d.eof || d.shut || d.sending || !d.queue.empty() || c->closing) {
+      return;
+    }
+    shutdown(d.to, SHUT_WR);
+    d.shut = true;
+    if (c->up.shut && c->down.shut) {
+      closeConn(c);
+    }
   }
 
-  Config const cfg_;
-  EpollRxConfig const rxCfg_;
-  int epoll_fd;
-  std::vector<struct epoll_event> events;
-  std::vector<char> rcvbuff;
-  std::vector<std::unique_ptr<EPollData>> listeners_;
-  std::unordered_set<EPollData*> sockets_;
-  struct msghdr recvmsgHdr_;
-  struct iovec recvmsgHdrIoVec_;
-};
+  void processCqe(struct io_uring_cqe* cqe, unsigned int& reads) {
+    switch (getTag(cqe->user_data)) {
+      case kAccept:
+        processAccept(cqe);
+        break;
+      case kRecvUp:
+      case kRecvDown:
+        ++reads;
+        processRecv(cqe, getTag(cqe->user_data) == kRecvUp);
+        break;
+      case kSendUp:
+      case kSendDown:
+        processSend(cqe, getTag(cqe->user_data) == kSendUp);
+        break;
+      case kConnect:
+        processConnect(cqe);
+        break;
+      default:
+        if (cqe->user_data == LIBURING_UDATA_TIMEOUT) {
+          break;
+        }
+        die("proxy: unexpected completion:", cqe->user_data);
+    }
+  }
 
-uint16_t pickPort(Config const& config) {
-  static uint16_t startPort =
-      config.use_port.size() ? config.use_port[0] : 10000 + rand() % 2000;
-  bool v6 = config.send_options.ipv6;
-  if (config.use_port.size()) {
-    return startPort++;
+  void recycle(uint16_t bid) {
+    --inUse_;
+    buffers_.returnIndex(bid);
   }
-  for (int i = 0; i < 1000; i++) {
-    auto port = startPort++;
-    if (v6) {
-      int v6 = mkBoundSock(port, true);
-      if (v6 < 0) {
-        continue;
+
+  // buffers the kernel can hand out right now. returns are only published
+  // to the ring in batches
+  size_t available() const {
+    size_t const held = inUse_ + buffers_.toProvideCount();
+    return held < buffers_.count() ? buffers_.count() - held : 0;
+  }
+
+  void rearm() {
+    if (!needsRearm_.empty()) {
+      auto todo = std::move(needsRearm_);
+      needsRearm_.clear();
+      for (auto [c, up] : todo) {
+        if (!c->closing && !(up ? c->up : c->down).armed) {
+          addRecv(c, up);
+        }
       }
-      close(v6);
-    } else {
-      int v4 = mkBoundSock(port, false);
-      if (v4 < 0) {
-        continue;
+    }
+    // those that ran out of buffers, as many as could get one
+    size_t const n = std::min(starved_.size(), available());
+    for (size_t i = 0; i < n; i++) {
+      auto [c, up] = starved_[i];
+      if (!c->closing && !(up ? c->up : c->down).armed) {
+        addRecv(c, up);
       }
-      close(v4);
     }
-    return port;
+    starved_.erase(starved_.begin(), starved_.begin() + n);
   }
-  die("no port found");
-  return 0;
-}
 
-void run(std::unique_ptr<RunnerBase> runner, std::atomic<bool>* shutdown) {
-  try {
-    runner->start();
-    runner->loop(shutdown);
-  } catch (InterruptedException const&) {
-    vlog("interrupted, cleaning up nicely");
-    runner->stop();
-    vlog("waiting until done:");
-    runner->loop(shutdown);
-    vlog("done");
-  } catch (std::exception const& ex) {
-    log("caught exception, terminating: ", ex.what());
-    throw;
+  void closeFds(Conn* c) {
+    // shutdown terminates the multishot receives
+    shutdown(c->up.from, SHUT_RDWR);
+    shutdown(c->up.to, SHUT_RDWR);
+    close(c->up.from);
+    close(c->up.to);
   }
-}
 
-struct Receiver {
-  std::unique_ptr<RunnerBase> r;
-  uint16_t port;
-  std::string name;
-  std::string rxCfg;
+  void closeConn(Conn* c) {
+    if (c->closing) {
+      return;
+    }
+    c->closing = true;
+    for (Direction* d : {&c->up, &c->down}) {
+      // the head might be in flight, recycled when that completes
+      while (d->queue.size() > (d->sending ? 1 : 0)) {
+        recycle(d->queue.back().bid);
+        d->queue.pop_back();
+      }
+    }
+    closeFds(c);
+  }
+
+  void maybeDelete(Conn* c) {
+    if (!c->closing || c->inflight) {
+      return;
+    }
+    // might still be queued for rearm
+    std::erase_if(needsRearm_, [c](auto const& x) { return x.first == c; });
+    std::erase_if(starved_, [c](auto const& x) { return x.first == c; });
+    conns_.erase(c);
+    delete c;
+    delSock();
+  }
+
+  struct io_uring ring_;
+  BufferProviderV2 buffers_;
+  std::deque<Listener> listeners_;
+  std::unordered_set<Conn*> conns_;
+  std::vector<std::pair<Conn*, bool>> needsRearm_;
+  std::vector<std::pair<Conn*, bool>> starved_;
+  size_t inUse_ = 0;
+  uint64_t enobufs_ = 0;
+  bool stopping_ = false;
 };
 
-Receiver makeEpollRx(Config const& cfg, EpollRxConfig const& rx_cfg) {
+Receiver makeProxyRx(Config const& cfg, ProxyRxConfig const& rx_cfg) {
   uint16_t port = pickPort(cfg);
-  auto runner =
-      std::make_unique<EPollRunner>(cfg, rx_cfg, strcat("epoll port=", port));
+  auto proxy_cfg = rx_cfg;
+  std::unique_ptr<RunnerBase> local_backend;
+  if (!proxy_cfg.backend_port) {
+    // nothing to forward to, so run a receiver in process
+    Receiver backend = makeEpollRx(cfg, EpollRxConfig{});
+    proxy_cfg.backend_port = backend.port;
+    local_backend = std::move(backend.r);
+  }
+
+  std::string const name = strcat("proxy port=", port);
+  std::unique_ptr<RunnerBase> runner;
+  int sock_flags = SOCK_NONBLOCK;
+  if (proxy_cfg.strategy == "io_uring") {
+    IoUringRxConfig io_uring_cfg;
+    io_uring_cfg.recv_size = proxy_cfg.recv_size;
+    io_uring_cfg.sqe_count = proxy_cfg.sqe_count;
+    io_uring_cfg.provided_buffer_count = proxy_cfg.provided_buffer_count;
+    auto [ring, new_cfg, ring_mem] = mkIoUring(io_uring_cfg);
+    runner = std::make_unique<IOUringProxyRunner>(
+        cfg, proxy_cfg, new_cfg, ring, name, std::move(local_backend));
+    runner->keepRingMemory(std::move(ring_mem));
+    // io_uring doesnt seem to like accepting on a nonblocking socket
+    sock_flags = 0;
+  } else if (proxy_cfg.strategy == "copy" || proxy_cfg.strategy == "splice") {
+    runner = std::make_unique<EPollProxyRunner>(
+        cfg, proxy_cfg, name, std::move(local_backend));
+  } else {
+    die("unknown proxy strategy ", proxy_cfg.strategy);
+  }
   runner->addListenSock(
-      mkServerSock(rx_cfg, port, cfg.send_options.ipv6, SOCK_NONBLOCK),
+      mkServerSock(proxy_cfg, port, cfg.send_options.ipv6, sock_flags),
       cfg.send_options.ipv6);
-  return Receiver{std::move(runner), port, "epoll", rx_cfg.describe()};
+  return Receiver{std::move(runner), port, "proxy", proxy_cfg.describe()};
 }
 
 template <size_t flags>
@@ -1819,20 +3268,36 @@ template <size_t MbFlag>
 void mbIoUringRxFactory(
     Config const& cfg,
     IoUringRxConfig const& rx_cfg,
+    struct io_uring ring,
     std::string const& name,
     size_t flags,
     std::unique_ptr<RunnerBase>& runner) {
-  if (flags == MbFlag) {
-    if (runner) {
-      die("already had a runner? flags=", flags, " this=", MbFlag);
+  if constexpr (isValidIoUringFlags(MbFlag)) {
+    if (flags == MbFlag) {
+      if (runner) {
+        die("already had a runner? flags=", flags, " this=", MbFlag);
+      }
+      runner = std::make_unique<
+          IOUringRunner<typename BasicSockPicker<MbFlag>::Sock>>(
+          cfg, rx_cfg, ring, name);
     }
-    auto [ring, new_cfg] = mkIoUring(rx_cfg);
-    runner =
-        std::make_unique<IOUringRunner<typename BasicSockPicker<MbFlag>::Sock>>(
-            cfg, new_cfg, ring, name);
   }
 }
 
+// flags picking the runner instantiation. needs the config as updated for
+// what the kernel supports
+size_t ioUringRunnerFlags(IoUringRxConfig const& rx_cfg) {
+  size_t flags = (rx_cfg.provide_buffers == 1 ? kUseBufferProviderFlag : 0) |
+      (rx_cfg.provide_buffers == 2 ? kUseBufferProviderV2Flag : 0);
+  if (rx_cfg.specialize) {
+    flags |= kSpecializedFlag | (rx_cfg.fixed_files ? kFixedFilesFlag : 0) |
+        (rx_cfg.multishot_recv ? kMultishotRecvFlag : 0) |
+        (rx_cfg.recvmsg ? kRecvmsgFlag : 0) |
+        (rx_cfg.cqe_skip_success_flag ? kCqeSkipSuccessFlag : 0);
+  }
+  return flags;
+}
+
 template <size_t... PossibleFlag>
 Receiver makeIoUringRx(
     Config const& cfg,
@@ -1841,19 +3306,26 @@ Receiver makeIoUringRx(
   uint16_t port = pickPort(cfg);
 
   std::unique_ptr<RunnerBase> runner;
-  size_t flags = (rx_cfg.provide_buffers == 1 ? kUseBufferProviderFlag : 0) |
-      (rx_cfg.provide_buffers == 2 ? kUseBufferProviderV2Flag : 0);
+  auto [ring, new_cfg, ring_mem] = mkIoUring(rx_cfg);
+  size_t const flags = ioUringRunnerFlags(new_cfg);
 
-  ((mbIoUringRxFactory<PossibleFlag>(
-       cfg, rx_cfg, strcat("io_uring port=", port), flags, runner)),
-   ...);
+  if (rx_cfg.splice_sink) {
+    runner = std::make_unique<IOUringSpliceSinkRunner>(
+        cfg, new_cfg, ring, strcat("io_uring splice_sink port=", port));
+  } else {
+    ((mbIoUringRxFactory<PossibleFlag>(
+         cfg, new_cfg, ring, strcat("io_uring port=", port), flags, runner)),
+     ...);
+  }
 
   if (!runner) {
+    io_uring_queue_exit(&ring);
     die("no factory for runner flags=",
         flags,
         " maybe you need to increase the index sequence "
         "size in the caller of this");
   }
+  runner->keepRingMemory(std::move(ring_mem));
 
   // io_uring doesnt seem to like accepting on a nonblocking socket
   int sock_flags = rx_cfg.supports_nonblock_accept ? SOCK_NONBLOCK : 0;
@@ -1889,6 +3361,14 @@ desc.add_options()
 ("host", po::value(&config.send_options.host))
 ("v6", po::value(&config.send_options.ipv6))
 ("time", po::value(&config.send_options.run_seconds))
+("series_interval_ms", po::value(&config.send_options.series_interval_ms)
+   ->default_value(config.send_options.series_interval_ms),
+ "interval of the tx and rx time series of throughput, errors and latency. "
+ "rx needs print_rx_stats. 0 for none")
+("results_file", po::value(&config.results_file),
+ "append a tab separated line per tx result to this file: name, rps, "
+ "bytes per second, p50 and p99 in us (within a burst for burst senders), "
+ "and whether the sender saturated")
 ("tx", po::value<std::vector<std::string> >()->multitoken(),
  "tx scenarios to run (can be multiple)")
 ("rx", po::value<std::vector<std::string> >()->multitoken(),
@@ -1905,7 +3385,7 @@ desc.add_options()
     for (auto tx : allScenarios()) {
       std::cerr << "    " << tx << "\n";
     }
-    std::cerr << "rx engines are: epoll, io_uring\n";
+    std::cerr << "rx engines are: epoll, io_uring, proxy\n";
     exit(1);
   }
   if (vm.count("verbose")) {
@@ -1963,6 +3443,10 @@ desc.add_options()
   if (config.server_only && config.client_only) {
     die("only one of server/client only please");
   }
+  if (config.send_options.series_interval_ms &&
+      config.send_options.series_interval_ms < 10) {
+    die("series_interval_ms must be 0 or at least 10");
+  }
 
   return config;
 }
@@ -1979,6 +3463,8 @@ std::pair<RxEngine, std::vector<std::string>> getRxEngine(
     return std::make_pair(RxEngine::Epoll, split);
   } else if (e == "io_uring") {
     return std::make_pair(RxEngine::IoUring, split);
+  } else if (e == "proxy") {
+    return std::make_pair(RxEngine::Proxy, split);
   } else {
     die("bad rx engine ", e);
   }
@@ -1988,8 +3474,10 @@ std::pair<RxEngine, std::vector<std::string>> getRxEngine(
 std::function<Receiver(Config const&)> parseRx(std::string const& parse) {
   IoUringRxConfig io_uring_cfg;
   EpollRxConfig epoll_cfg;
+  ProxyRxConfig proxy_cfg;
   po::options_description epoll_desc;
   po::options_description io_uring_desc;
+  po::options_description proxy_desc;
 
   // clang-format off
 auto add_base = [&](po::options_description& d, RxConfig& cfg) {
@@ -1999,12 +3487,35 @@ auto add_base = [&](po::options_description& d, RxConfig& cfg) {
 ("recv_size", po::value(&cfg.recv_size)->default_value(cfg.recv_size))
 ("recvmsg",  po::value(&cfg.recvmsg)->default_value(cfg.recvmsg))
 ("workload",  po::value(&cfg.workload)->default_value(cfg.workload))
+("residence_time",  po::value(&cfg.residence_time)
+   ->default_value(cfg.residence_time),
+ "measure time from a request being parsed until its response is sent")
+("timestamping",  po::value(&cfg.timestamping)
+   ->default_value(cfg.timestamping),
+ "collect SO_TIMESTAMPING software rx/tx timestamps (implies recvmsg)")
+("echo",  po::value(&cfg.echo)->default_value(cfg.echo),
+ "respond with the request payload rather than a dummy response")
+("rcvbuf",  po::value(&cfg.rcvbuf)->default_value(cfg.rcvbuf),
+ "SO_RCVBUF for accepted sockets (0 for kernel autotuning)")
+("splice_sink",  po::value(&cfg.splice_sink)->default_value(cfg.splice_sink),
+ "splice received data to /dev/null without parsing (use with stream tx)")
+("huge_pages",  po::value(&cfg.buffers.huge_pages)
+   ->default_value(cfg.buffers.huge_pages),
+ "back receive buffers with explicit 2MB huge pages")
+("thp",  po::value(&cfg.buffers.thp)->default_value(cfg.buffers.thp),
+ "madvise(MADV_HUGEPAGE) receive buffers")
+("prefault",  po::value(&cfg.buffers.prefault)
+   ->default_value(cfg.buffers.prefault),
+ "fault in receive buffers before starting")
+("mlock",  po::value(&cfg.buffers.mlock)->default_value(cfg.buffers.mlock),
+ "mlock receive buffers")
 ("description",  po::value(&cfg.description))
   ;
 };
 
 add_base(epoll_desc, epoll_cfg);
 add_base(io_uring_desc, io_uring_cfg);
+add_base(proxy_desc, proxy_cfg);
 
 io_uring_desc.add_options()
   ("provide_buffers",  po::value(&io_uring_cfg.provide_buffers)
@@ -2013,8 +3524,6 @@ io_uring_desc.add_options()
      ->default_value(io_uring_cfg.fixed_files))
   ("max_cqe_loop",  po::value(&io_uring_cfg.max_cqe_loop)
      ->default_value(io_uring_cfg.max_cqe_loop))
-  ("huge_pages",  po::value(&io_uring_cfg.huge_pages)
-     ->default_value(io_uring_cfg.huge_pages))
   ("multishot_recv",  po::value(&io_uring_cfg.multishot_recv)
      ->default_value(io_uring_cfg.multishot_recv))
   ("supports_nonblock_accept",  po::value(&io_uring_cfg.supports_nonblock_accept)
@@ -2033,13 +3542,65 @@ io_uring_desc.add_options()
      ->default_value(io_uring_cfg.provided_buffer_low_watermark))
   ("provided_buffer_compact", po::value(&io_uring_cfg.provided_buffer_compact)
      ->default_value(io_uring_cfg.provided_buffer_compact))
+  ("provided_buffer_bitmap", po::value(&io_uring_cfg.provided_buffer_bitmap)
+     ->default_value(io_uring_cfg.provided_buffer_bitmap),
+   "track returned provide_buffers=1 buffers in a bitmap, not sorted ranges")
+  ("provided_buffer_sizes", po::value(&io_uring_cfg.provided_buffer_sizes),
+   "size classes as size:count,size:count. each read picks the class for the "
+   "rest of the request it is in the middle of")
+  ("provided_buffer_max_groups", po::value(&io_uring_cfg.provided_buffer_max_groups)
+     ->default_value(io_uring_cfg.provided_buffer_max_groups),
+   "grow the pool by up to this many groups of provided_buffer_count buffers "
+   "when the kernel runs out")
+  ("provided_buffer_shrink_ms", po::value(&io_uring_cfg.provided_buffer_shrink_ms)
+     ->default_value(io_uring_cfg.provided_buffer_shrink_ms),
+   "retire an extra group after this long without running out")
   ("defer_taskrun", po::value(&io_uring_cfg.defer_taskrun)
      ->default_value(io_uring_cfg.defer_taskrun))
+  ("specialize", po::value(&io_uring_cfg.specialize)
+     ->default_value(io_uring_cfg.specialize),
+   "compile fixed_files, multishot_recv, recvmsg and cqe skipping into the "
+   "runner rather than checking them on every operation")
+  ("pbuf_ring_mmap", po::value(&io_uring_cfg.pbuf_ring_mmap)
+     ->default_value(io_uring_cfg.pbuf_ring_mmap),
+   "let the kernel allocate provided buffer rings (IOU_PBUF_RING_MMAP)")
+  ("no_mmap", po::value(&io_uring_cfg.no_mmap)
+     ->default_value(io_uring_cfg.no_mmap),
+   "put the SQ/CQ rings in a huge page of our own (IORING_SETUP_NO_MMAP)")
+  ("max_sends_in_flight", po::value(&io_uring_cfg.max_sends_in_flight)
+     ->default_value(io_uring_cfg.max_sends_in_flight),
+   "per socket limit on sends in flight (0 for none). later responses are "
+   "held back and sent together when one completes. not with echo")
   ;
 
 epoll_desc.add_options()
   ("batch_send",  po::value(&epoll_cfg.batch_send)
      ->default_value(epoll_cfg.batch_send))
+  ("zerocopy_recv",  po::value(&epoll_cfg.zerocopy_recv)
+     ->default_value(epoll_cfg.zerocopy_recv),
+   "map received pages with TCP_ZEROCOPY_RECEIVE rather than copying")
+  ("max_to_write",  po::value(&epoll_cfg.max_to_write)
+     ->default_value(epoll_cfg.max_to_write),
+   "stop reading a socket with this many bytes of responses unsent until it "
+   "catches up (0 for no limit)")
+  ;
+
+proxy_desc.add_options()
+  ("strategy",  po::value(&proxy_cfg.strategy)
+     ->default_value(proxy_cfg.strategy),
+   "how to move bytes: copy, splice or io_uring")
+  ("backend_host",  po::value(&proxy_cfg.backend_host)
+     ->default_value(proxy_cfg.backend_host))
+  ("backend_port",  po::value(&proxy_cfg.backend_port)
+     ->default_value(proxy_cfg.backend_port),
+   "port to forward to, 0 runs an epoll receiver in process")
+  ("pipe_size",  po::value(&proxy_cfg.pipe_size)
+     ->default_value(proxy_cfg.pipe_size),
+   "F_SETPIPE_SZ for splice pipes, 0 leaves the default")
+  ("sqe_count", po::value(&proxy_cfg.sqe_count)
+     ->default_value(proxy_cfg.sqe_count))
+  ("provided_buffer_count", po::value(&proxy_cfg.provided_buffer_count)
+     ->default_value(proxy_cfg.provided_buffer_count))
   ;
 
   // clang-format on
@@ -2053,9 +3614,52 @@ epoll_desc.add_options()
     case RxEngine::Epoll:
       used_desc = &epoll_desc;
       break;
+    case RxEngine::Proxy:
+      used_desc = &proxy_desc;
+      break;
   };
 
-  simpleParse(*used_desc, splits);
+  auto const vm = simpleParse(*used_desc, splits);
+
+  // rx timestamps come back as cmsgs
+  io_uring_cfg.recvmsg |= io_uring_cfg.timestamping;
+  epoll_cfg.recvmsg |= epoll_cfg.timestamping;
+  // timestamping is turned on for each accepted socket, which needs its fd
+  if (io_uring_cfg.fixed_files && io_uring_cfg.timestamping) {
+    if (!vm["fixed_files"].defaulted()) {
+      die("fixed_files does not support timestamping");
+    }
+    log("timestamping: turning off fixed_files");
+    io_uring_cfg.fixed_files = false;
+  }
+  if (epoll_cfg.zerocopy_recv && epoll_cfg.recvmsg) {
+    die("zerocopy_recv does not support recvmsg or timestamping");
+  }
+  if (io_uring_cfg.max_sends_in_flight < 0 ||
+      (io_uring_cfg.max_sends_in_flight && io_uring_cfg.echo)) {
+    die("max_sends_in_flight must be positive, and not used with echo");
+  }
+
+  if (!io_uring_cfg.provided_buffer_sizes.empty()) {
+    for (auto const& c :
+         po::split_unix(io_uring_cfg.provided_buffer_sizes, ",")) {
+      size_t size, count;
+      char extra;
+      if (sscanf(c.c_str(), "%zu:%zu%c", &size, &count, &extra) != 2 ||
+          !size || !count) {
+        die("bad provided_buffer_sizes entry '", c, "', want size:count");
+      }
+      io_uring_cfg.provided_buffer_classes.emplace_back(size, count);
+    }
+    std::sort(
+        io_uring_cfg.provided_buffer_classes.begin(),
+        io_uring_cfg.provided_buffer_classes.end());
+    // a multishot recv keeps the class it was armed with
+    if (io_uring_cfg.multishot_recv) {
+      log("provided_buffer_sizes: turning off multishot_recv");
+      io_uring_cfg.multishot_recv = 0;
+    }
+  }
 
   if (io_uring_cfg.provided_buffer_low_watermark < 0) {
     // default to quarter unless explicitly told
@@ -2066,13 +3670,20 @@ epoll_desc.add_options()
   switch (engine) {
     case RxEngine::IoUring:
       return [io_uring_cfg](Config const& cfg) -> Receiver {
-        return makeIoUringRx(cfg, io_uring_cfg, std::make_index_sequence<4>{});
+        return makeIoUringRx(
+            cfg,
+            io_uring_cfg,
+            std::make_index_sequence<kIoUringFlagCombinations>{});
       };
     case RxEngine::Epoll:
       return [epoll_cfg](Config const& cfg) -> Receiver {
         return makeEpollRx(cfg, epoll_cfg);
       };
       break;
+    case RxEngine::Proxy:
+      return [proxy_cfg](Config const& cfg) -> Receiver {
+        return makeProxyRx(cfg, proxy_cfg);
+      };
   };
   die("bad engine ", (int)engine);
   return {};
@@ -2115,6 +3726,35 @@ struct AggregateResults {
   SimpleAggregate<double> bytesPerSecond;
 };
 
+// for perfcheck.sh, and anything else that wants to compare runs
+void appendResults(
+    std::string const& path,
+    std::vector<std::pair<std::string, SendResults>> const& results) {
+  FILE* f = fopen(path.c_str(), "a");
+  if (!f) {
+    die("unable to open results file ", path, ": ", strerror(errno));
+  }
+  for (auto const& r : results) {
+    LatencyResult burst;
+    LatencyResult const* lat = &r.second.latencies;
+    if (!lat->count && !r.second.burstResults.empty()) {
+      // burst senders only time each response from the start of its burst
+      burst = LatencyResult::avgMerge(r.second.burstResults);
+      lat = &burst;
+    }
+    fprintf(
+        f,
+        "%s\t%.0f\t%.0f\t%ld\t%ld\t%d\n",
+        r.first.c_str(),
+        r.second.packetsPerSecond,
+        r.second.bytesPerSecond,
+        (long)lat->p50.count(),
+        (long)lat->p99.count(),
+        (int)r.second.saturated());
+  }
+  fclose(f);
+}
+
 AggregateResults aggregateResults(std::vector<SendResults> const& results) {
   std::vector<double> pps;
   std::vector<double> bps;
@@ -2177,6 +3817,8 @@ int main(int argc, char** argv) {
   if (cfg.tx.size()) {
     for (auto const& tx : cfg.tx) {
       for (auto const& r : receiver_factories) {
+        // start before the receiver so its buffers are counted
+        MemoryMonitor memory;
         Receiver rcv = r();
         std::atomic<bool> should_shutdown{false};
         log("running ", tx, " for ", rcv.name, " cfg=", rcv.rxCfg);
@@ -2192,6 +3834,12 @@ int main(int argc, char** argv) {
         log("...done sender");
         rcv_thread.join();
         log("...done receiver");
+        res.memory = memory.finish();
+        auto const per_opts = PerSendOptions::parseOptions(tx).second;
+        res.memory->connections = per_opts.threads * per_opts.per_thread;
+        res.slowest.forEach([](SlowRequest& s) {
+          s.rx_events = RxEventLog::get().describe(s.queued, s.done);
+        });
         results.emplace_back(
             strcat("tx:", tx, " rx:", rcv.name, " ", rcv.rxCfg),
             std::move(res));
@@ -2201,6 +3849,24 @@ int main(int argc, char** argv) {
     for (auto& r : results) {
       log(r.first);
       log(std::string(30, ' '), r.second.toString());
+      if (!r.second.series.empty()) {
+        log(std::string(30, ' '),
+            "time series\n",
+            r.second.series.toString(std::string(32, ' '), "errors"));
+      }
+      for (auto const& s : r.second.slowest.sorted()) {
+        log(std::string(30, ' '), "slow request ", s.toString());
+      }
+      if (r.second.saturated()) {
+        log(std::string(30, ' '),
+            "WARNING: the sender was saturated, so this may measure the "
+            "client rather than the receiver. try more --tx threads, or "
+            "--loop submit_and_wait");
+      }
+    }
+
+    if (!cfg.results_file.empty()) {
+      appendResults(cfg.results_file, results);
     }
 
     // build up to_agg but do it in insertion order of results
@@ -2233,6 +3899,7 @@ int main(int argc, char** argv) {
 
   } else {
     // no built in sender mode
+    MemoryMonitor memory;
     std::atomic<bool> should_shutdown{false};
     std::vector<Receiver> receivers;
     std::vector<std::thread> receiver_threads;
@@ -2263,6 +3930,7 @@ int main(int argc, char** argv) {
       vlog("waiting for ", receivers[i].name);
       receiver_threads[i].join();
     }
+    log("receivers", memory.finish().toString());
   }
 
   vlog("all done");
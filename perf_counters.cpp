@@ -0,0 +1,113 @@
+#include "perf_counters.h"
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "util.h"
+
+namespace {
+
+std::chrono::nanoseconds threadCpuTime() {
+  struct timespec ts;
+  checkedErrno(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts), "thread cputime");
+  return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+} // namespace
+
+PerfCounter::PerfCounter(uint32_t type, uint64_t config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.exclude_hv = 1;
+  fd_ = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  if (fd_ < 0) {
+    vlog("perf_event_open type=", type, " config=", config, " failed: ",
+         strerror(errno));
+  }
+}
+
+PerfCounter::~PerfCounter() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+PerfCounter::PerfCounter(PerfCounter&& o) noexcept : fd_(o.fd_) {
+  o.fd_ = -1;
+}
+
+PerfCounter& PerfCounter::operator=(PerfCounter&& o) noexcept {
+  std::swap(fd_, o.fd_);
+  return *this;
+}
+
+PerfCounter PerfCounter::cycles() {
+  return PerfCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+}
+
+PerfCounter PerfCounter::instructions() {
+  return PerfCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+}
+
+PerfCounter PerfCounter::dtlbMisses() {
+  return PerfCounter(
+      PERF_TYPE_HW_CACHE,
+      PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+}
+
+PerfCounter PerfCounter::pageFaults() {
+  return PerfCounter(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+}
+
+std::optional<uint64_t> PerfCounter::read() const {
+  uint64_t val;
+  if (fd_ < 0 || ::read(fd_, &val, sizeof(val)) != sizeof(val)) {
+    return {};
+  }
+  return val;
+}
+
+void ThreadCpu::Counter::start() {
+  started = counter.read().value_or(0);
+}
+
+std::optional<uint64_t> ThreadCpu::Counter::sample() const {
+  if (auto c = counter.read()) {
+    return *c - started;
+  }
+  return {};
+}
+
+void ThreadCpu::start() {
+  if (!cycles_) {
+    cycles_.emplace(PerfCounter::cycles());
+    instructions_.emplace(PerfCounter::instructions());
+    dtlbMisses_.emplace(PerfCounter::dtlbMisses());
+    pageFaults_.emplace(PerfCounter::pageFaults());
+  }
+  cycles_->start();
+  instructions_->start();
+  dtlbMisses_->start();
+  pageFaults_->start();
+  cpuStart_ = threadCpuTime();
+}
+
+ThreadCpu::Usage ThreadCpu::sample() const {
+  Usage ret;
+  ret.cpu = threadCpuTime() - cpuStart_;
+  if (cycles_) {
+    ret.cycles = cycles_->sample();
+    ret.instructions = instructions_->sample();
+    ret.dtlb_misses = dtlbMisses_->sample();
+    ret.page_faults = pageFaults_->sample();
+  }
+  return ret;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+// a hardware counter for the calling thread, using perf_event_open. these are
+// often unavailable (VMs, containers, perf_event_paranoid) in which case
+// valid() is false and reads return nothing
+class PerfCounter {
+ public:
+  PerfCounter(uint32_t type, uint64_t config);
+  ~PerfCounter();
+  PerfCounter(PerfCounter const&) = delete;
+  PerfCounter& operator=(PerfCounter const&) = delete;
+  PerfCounter(PerfCounter&& o) noexcept;
+  PerfCounter& operator=(PerfCounter&& o) noexcept;
+
+  static PerfCounter cycles();
+  static PerfCounter instructions();
+  static PerfCounter dtlbMisses();
+  static PerfCounter pageFaults();
+
+  bool valid() const {
+    return fd_ >= 0;
+  }
+
+  // count since construction
+  std::optional<uint64_t> read() const;
+
+ private:
+  int fd_ = -1;
+};
+
+// cpu time, cycles and memory overheads of the calling thread since start()
+class ThreadCpu {
+ public:
+  struct Usage {
+    std::chrono::nanoseconds cpu{0};
+    std::optional<uint64_t> cycles;
+    std::optional<uint64_t> instructions;
+    std::optional<uint64_t> dtlb_misses;
+    std::optional<uint64_t> page_faults;
+  };
+
+  void start();
+  Usage sample() const;
+
+ private:
+  struct Counter {
+    explicit Counter(PerfCounter&& c) : counter(std::move(c)) {}
+    void start();
+    std::optional<uint64_t> sample() const;
+
+    PerfCounter counter;
+    uint64_t started = 0;
+  };
+
+  std::chrono::nanoseconds cpuStart_{0};
+  std::optional<Counter> cycles_;
+  std::optional<Counter> instructions_;
+  std::optional<Counter> dtlbMisses_;
+  std::optional<Counter> pageFaults_;
+};
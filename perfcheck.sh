@@ -0,0 +1,162 @@
+#!/bin/bash
+# Performance regression check: runs a fixed matrix of single process
+# loopback scenarios and compares their throughput and p99 latency against a
+# baseline stored for this machine, failing if any got worse by more than the
+# tolerance. Meant to be run before and after kernel and liburing updates.
+#
+#   ./perfcheck.sh [-b baseline.tsv] [-t rps_pct] [-l p99_pct] [-m p99_min_us]
+#                  [-s seconds] [-r runs] [-u] ./netbench
+#
+#   -b  baseline file, default perfcheck/<hostname>.tsv
+#   -t  allowed throughput drop in percent (default 10)
+#   -l  allowed p99 increase in percent (default 25)
+#   -m  p99 changes smaller than this many us are noise (default 20)
+#   -s  seconds per run (default 3)
+#   -r  runs per scenario, the median is used (default 3)
+#   -u  write the baseline from this run rather than comparing
+#
+# with no baseline yet this run becomes it. the kernel and liburing the
+# baseline was taken on are kept in it, and printed alongside any regression.
+set -euo pipefail
+
+BASELINE="perfcheck/$(hostname -s).tsv"
+RPS_PCT=10
+P99_PCT=25
+P99_MIN_US=20
+SECONDS_PER_RUN=3
+RUNS=3
+UPDATE=0
+while getopts "b:t:l:m:s:r:u" opt; do
+  case $opt in
+    b) BASELINE=$OPTARG ;;
+    t) RPS_PCT=$OPTARG ;;
+    l) P99_PCT=$OPTARG ;;
+    m) P99_MIN_US=$OPTARG ;;
+    s) SECONDS_PER_RUN=$OPTARG ;;
+    r) RUNS=$OPTARG ;;
+    u) UPDATE=1 ;;
+    *) exit 1 ;;
+  esac
+done
+shift $((OPTIND - 1))
+TARGET=${1:-./netbench}
+
+# name|arguments. changing these invalidates the baselines
+TX=(
+  "small|epoll --size 64"
+  "burst|burst"
+)
+RX=(
+  "epoll|epoll"
+  "io_uring_pb0|io_uring --provide_buffers 0"
+  "io_uring_pb1|io_uring --provide_buffers 1"
+  "io_uring_pb2|io_uring --provide_buffers 2"
+)
+
+# static builds (STATIC_LIBS=1) have no liburing to point to
+LIBURING=$(ldd "$TARGET" 2>/dev/null | awk '/liburing/ { print $3 }' || true)
+if [[ -n $LIBURING ]]; then
+  LIBURING=$(readlink -f "$LIBURING")
+fi
+DESCRIBE="kernel=$(uname -r) liburing=${LIBURING:-static}"
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+median() {
+  sort -n | awk '{ v[NR] = $1 } END { print v[int((NR + 1) / 2)] }'
+}
+
+echo "# $DESCRIBE" >"$WORK/current.tsv"
+for tx in "${TX[@]}"; do
+  for rx in "${RX[@]}"; do
+    name="${tx%%|*}/${rx%%|*}"
+    echo "running $name" >&2
+    "$TARGET" --v6 0 --time "$SECONDS_PER_RUN" --runs "$RUNS" \
+      --series_interval_ms 0 --print_rx_stats 0 \
+      --results_file "$WORK/$$.tsv" \
+      --tx "${tx#*|}" --rx "${rx#*|}" >"$WORK/log" 2>&1 || {
+      cat "$WORK/log" >&2
+      echo "$name failed" >&2
+      exit 1
+    }
+    printf "%s\t%s\t%s\t%s\n" "$name" \
+      "$(cut -f2 "$WORK/$$.tsv" | median)" \
+      "$(cut -f5 "$WORK/$$.tsv" | median)" \
+      "$(cut -f6 "$WORK/$$.tsv" | sort -n | tail -1)" >>"$WORK/current.tsv"
+    rm "$WORK/$$.tsv"
+  done
+done
+
+if [[ $UPDATE == 1 || ! -f $BASELINE ]]; then
+  mkdir -p "$(dirname "$BASELINE")"
+  cp "$WORK/current.tsv" "$BASELINE"
+  echo "wrote baseline $BASELINE"
+  cat "$BASELINE"
+  exit 0
+fi
+
+# columns are name, rps, p99 in us, saturated
+awk -F'\t' -v rps_pct="$RPS_PCT" -v p99_pct="$P99_PCT" \
+  -v p99_min="$P99_MIN_US" -v baseline="$BASELINE" '
+function change(b, n) {
+  return b > 0 ? sprintf("%+.1f%%", 100.0 * (n - b) / b) : "-"
+}
+
+function row(name, metric, b, n, status) {
+  printf "%-28s %-7s %12s %12s %9s  %s\n", name, metric, b, n, change(b, n),
+      status
+}
+
+FNR == 1 {
+  desc[FILENAME == baseline ? "baseline" : "now"] = substr($0, 3)
+  next
+}
+
+FILENAME == baseline {
+  base_rps[$1] = $2
+  base_p99[$1] = $3
+  next
+}
+
+{
+  if (!($1 in base_rps)) {
+    row($1, "rps", "-", $2, "NEW")
+    next
+  }
+  note = $4 ? " (sender saturated)" : ""
+  status = "ok"
+  if ($2 < base_rps[$1] * (1 - rps_pct / 100.0)) {
+    status = "REGRESSED"
+    regressions++
+  }
+  row($1, "rps", base_rps[$1], $2, status note)
+  status = "ok"
+  if ($3 > base_p99[$1] * (1 + p99_pct / 100.0) &&
+      $3 - base_p99[$1] > p99_min) {
+    status = "REGRESSED"
+    regressions++
+  }
+  row($1, "p99_us", base_p99[$1], $3, status note)
+  delete base_rps[$1]
+}
+
+BEGIN {
+  printf "%-28s %-7s %12s %12s %9s\n", "scenario", "metric", "baseline",
+      "now", "change"
+}
+
+END {
+  for (name in base_rps) {
+    row(name, "rps", base_rps[name], "-", "MISSING")
+  }
+  print ""
+  print "baseline: " desc["baseline"]
+  print "now:      " desc["now"]
+  if (regressions) {
+    printf "%d regressions (tolerance rps -%s%%, p99 +%s%% and +%sus)\n",
+        regressions, rps_pct, p99_pct, p99_min
+    exit 1
+  }
+  print "no regressions"
+}' "$BASELINE" "$WORK/current.tsv"
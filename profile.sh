@@ -0,0 +1,141 @@
+#!/bin/bash
+# Runs netbench under perf record along with its USDT markers (see trace.h),
+# and splits the cpu samples up by the phase each thread was in when they
+# were taken:
+#   batch     handling a batch of completions (io_uring) or events (epoll)
+#   workload  spinning in runWorkload
+#   outside   anything else: waiting, submitting, loop bookkeeping, and all
+#             of a thread that has no markers
+#
+#   ./profile.sh [-o outdir] [-b ./netbench] -- <netbench args>
+#
+# writes outdir/perf.data and outdir/folded.txt (one "thread;phase;stack
+# count" per line, for flamegraph.pl, which also makes outdir/flame.svg if it
+# is on the PATH), and prints the samples per thread and phase.
+#
+# only the phase markers are recorded by default as the others fire for every
+# request. add them with eg PROFILE_MARKERS="request_parsed send_queued"
+# to also get their counts per phase.
+#
+# needs perf, and netbench built with sys/sdt.h available
+set -euo pipefail
+
+OUT=profile.out
+BIN=./netbench
+while getopts "o:b:" opt; do
+  case $opt in
+    o) OUT=$OPTARG ;;
+    b) BIN=$OPTARG ;;
+    *) exit 1 ;;
+  esac
+done
+shift $((OPTIND - 1))
+
+MARKERS="batch_start batch_end workload_start workload_end ${PROFILE_MARKERS:-}"
+
+mkdir -p "$OUT"
+perf buildid-cache --add "$BIN"
+trap "perf probe --del 'sdt_netbench:*' >/dev/null 2>&1 || true" EXIT
+EVENTS=(-e cycles)
+for m in $MARKERS; do
+  if ! perf probe --add "sdt_netbench:$m" >/dev/null 2>&1; then
+    echo "no sdt_netbench:$m marker in $BIN, was it built with sys/sdt.h?" >&2
+    exit 1
+  fi
+  EVENTS+=(-e "sdt_netbench:$m")
+done
+
+perf record -o "$OUT/perf.data" -g "${EVENTS[@]}" -- "$BIN" "$@"
+
+perf script -i "$OUT/perf.data" -F comm,tid,event,ip,sym 2>/dev/null |
+  awk -v folded="$OUT/folded.txt" '
+function phaseOf(t) {
+  return (t in phase) ? phase[t] : "outside"
+}
+
+function flush(    p, stack, i, m) {
+  if (event == "") {
+    return
+  }
+  p = phaseOf(tid)
+  if (event ~ /^sdt_netbench:/) {
+    m = substr(event, length("sdt_netbench:") + 1)
+    if (m == "batch_start") {
+      phase[tid] = "batch"
+    } else if (m == "batch_end") {
+      phase[tid] = "outside"
+    } else if (m == "workload_start") {
+      before[tid] = p
+      phase[tid] = "workload"
+    } else if (m == "workload_end") {
+      phase[tid] = (tid in before) ? before[tid] : "outside"
+    } else {
+      markers[comm "\t" p "\t" m]++
+    }
+  } else {
+    stack = comm ";" p
+    for (i = nframes; i >= 1; i--) {
+      stack = stack ";" frames[i]
+    }
+    stacks[stack]++
+    samples[comm "\t" p]++
+    threadSamples[comm]++
+  }
+  event = ""
+  nframes = 0
+}
+
+/^[ \t]*$/ {
+  flush()
+  next
+}
+
+# a stack frame, leaf first: "ip symbol"
+/^[ \t]/ {
+  sym = $0
+  sub(/^[ \t]*[0-9a-f]+ /, "", sym)
+  gsub(/;/, ":", sym)
+  frames[++nframes] = sym
+  next
+}
+
+# "comm tid event: ...", where comm may have spaces in it
+{
+  flush()
+  for (i = 1; i <= NF && $i !~ /^[0-9]+$/; i++) {
+  }
+  comm = $1
+  for (j = 2; j < i; j++) {
+    comm = comm " " $j
+  }
+  gsub(/ /, "_", comm)
+  tid = $i
+  event = "sample"
+  for (j = i + 1; j <= NF; j++) {
+    if ($j ~ /:$/) {
+      event = substr($j, 1, length($j) - 1)
+      break
+    }
+  }
+}
+
+END {
+  flush()
+  for (s in stacks) {
+    print s, stacks[s] > folded
+  }
+  printf "%-20s %-10s %10s %8s\n", "thread", "phase", "samples", "pct"
+  for (k in samples) {
+    split(k, f, "\t")
+    printf "%-20s %-10s %10d %7.2f%%\n", f[1], f[2], samples[k],
+        100.0 * samples[k] / threadSamples[f[1]]
+  }
+  for (k in markers) {
+    split(k, f, "\t")
+    printf "%-20s %-10s %10d %s\n", f[1], f[2], markers[k], f[3]
+  }
+}'
+
+if command -v flamegraph.pl >/dev/null; then
+  flamegraph.pl "$OUT/folded.txt" >"$OUT/flame.svg"
+fi
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+#include "util.h"
+
+struct ConsumeResults {
+  size_t to_write = 0;
+  uint32_t count = 0;
+  // when the oldest request in here was fully parsed. only set when measuring
+  // residence time
+  std::chrono::steady_clock::time_point parsed_at;
+
+  ConsumeResults& operator+=(ConsumeResults const& rhs) {
+    if (!count) {
+      parsed_at = rhs.parsed_at;
+    }
+    to_write += rhs.to_write;
+    count += rhs.count;
+    return *this;
+  }
+};
+
+// benchmark protocol is <uint32_t length>:<payload of size length>
+// response is a single byte when it is received
+struct ProtocolParser {
+  // consume data and return number of new sends
+  ConsumeResults consume(char const* data, size_t n) {
+    return consume(data, n, [](char const*, size_t) {});
+  }
+
+  // as above, but also calls on_payload(data, len) for each run of payload
+  // bytes (ie excluding the headers) in the order they were received
+  template <class OnPayload>
+  ConsumeResults consume(char const* data, size_t n, OnPayload&& on_payload) {
+    ConsumeResults ret;
+    while (n > 0) {
+      if (size_buff_have < sizeof(is_reading)) {
+        if (likely(n >= sizeof(is_reading) && size_buff_have == 0)) {
+          memcpy(&is_reading, data, sizeof(is_reading));
+          size_buff_have = sizeof(is_reading);
+          data += sizeof(is_reading);
+          n -= sizeof(is_reading);
+        } else {
+          uint32_t size_buff_add =
+              std::min<uint32_t>(n, sizeof(is_reading) - size_buff_have);
+          memcpy(size_buff + size_buff_have, data, size_buff_add);
+          size_buff_have += size_buff_add;
+          data += size_buff_add;
+          n -= size_buff_add;
+          if (size_buff_have < sizeof(is_reading)) {
+            break;
+          }
+          memcpy(&is_reading, size_buff, sizeof(is_reading));
+        }
+      }
+      uint32_t payload = std::min<size_t>(n, is_reading[0] - so_far);
+      if (payload) {
+        on_payload(data, payload);
+        so_far += payload;
+        data += payload;
+        n -= payload;
+      }
+      if (so_far < is_reading[0]) {
+        break;
+      }
+      ret.to_write += is_reading[1];
+      ret.count++;
+      so_far = size_buff_have = 0;
+    }
+    return ret;
+  }
+
+  // payload still to come for the request being read. 0 between requests, or
+  // if the header is not all here yet, as then the size is not known
+  uint32_t pending() const {
+    return size_buff_have == sizeof(is_reading) ? is_reading[0] - so_far : 0;
+  }
+
+  uint32_t size_buff_have = 0;
+  std::array<uint32_t, 2> is_reading = {{0}};
+  char size_buff[sizeof(is_reading)];
+  // payload bytes of the current request read so far
+  uint32_t so_far = 0;
+};
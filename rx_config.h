@@ -0,0 +1,216 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "buffers.h"
+#include "util.h"
+
+struct RxConfig {
+  int backlog = 100000;
+  int max_events = 32;
+  int recv_size = 4096;
+  bool recvmsg = false;
+  size_t workload = 0;
+  bool residence_time = false;
+  bool timestamping = false;
+  bool echo = false;
+  // SO_RCVBUF for accepted sockets, 0 leaves the kernel autotuning it
+  int rcvbuf = 0;
+  // splice everything to /dev/null without parsing it
+  bool splice_sink = false;
+  // backing for the receive buffers
+  BufferOptions buffers;
+  std::string description;
+
+  std::string describe() const {
+    if (description.empty()) {
+      return toString();
+    }
+    return description;
+  }
+
+  virtual std::string const toString() const {
+    // only give the important options:
+    auto is_default = [this](auto RxConfig::*x) {
+      RxConfig base;
+      return this->*x == base.*x;
+    };
+    return strcat(
+        is_default(&RxConfig::recvmsg) ? "" : strcat(" recvmsg=", recvmsg),
+        is_default(&RxConfig::workload) ? "" : strcat(" workload=", workload),
+        is_default(&RxConfig::residence_time)
+            ? ""
+            : strcat(" residence_time=", residence_time),
+        is_default(&RxConfig::timestamping)
+            ? ""
+            : strcat(" timestamping=", timestamping),
+        is_default(&RxConfig::echo) ? "" : strcat(" echo=", echo),
+        is_default(&RxConfig::rcvbuf) ? "" : strcat(" rcvbuf=", rcvbuf),
+        is_default(&RxConfig::splice_sink)
+            ? ""
+            : strcat(" splice_sink=", splice_sink),
+        buffers.toString());
+  }
+};
+
+struct IoUringRxConfig : RxConfig {
+  bool supports_nonblock_accept = false;
+  bool register_ring = true;
+  int provide_buffers = 2;
+  bool fixed_files = true;
+  int sqe_count = 64;
+  int cqe_count = 0;
+  int max_cqe_loop = 256 * 32;
+  int provided_buffer_count = 8000;
+  int fixed_file_count = 16000;
+  int provided_buffer_low_watermark = -1;
+  int provided_buffer_compact = 1;
+  // track returned buffers for provide_buffers=1 in a bitmap rather than a
+  // list of ranges that needs sorting once returns come out of order
+  bool provided_buffer_bitmap = false;
+  // extra groups of provided_buffer_count buffers to register when the
+  // kernel runs out, and how long it must be quiet before one is retired
+  int provided_buffer_max_groups = 1;
+  int provided_buffer_shrink_ms = 1000;
+  // size classes as "size:count,size:count", replacing a single class of
+  // provided_buffer_count buffers of recv_size. parsed into the below
+  std::string provided_buffer_sizes;
+  std::vector<std::pair<size_t, size_t>> provided_buffer_classes;
+  int multishot_recv = 1;
+  bool defer_taskrun = false;
+  // use a runner built for these options, rather than a generic one
+  bool specialize = true;
+  // provided buffer rings allocated by the kernel (IOU_PBUF_RING_MMAP)
+  bool pbuf_ring_mmap = false;
+  // SQ/CQ rings in a huge page we allocate (IORING_SETUP_NO_MMAP)
+  bool no_mmap = false;
+  // per socket limit on sends in flight, 0 for none. responses beyond it are
+  // held back and go out together as one send when an earlier one completes
+  int max_sends_in_flight = 0;
+
+  // not for actual user updating, but dependent on the kernel:
+  unsigned int cqe_skip_success_flag = 0;
+
+  std::string const toString() const override {
+    // only give the important options:
+    auto is_default = [this](auto IoUringRxConfig::*x) {
+      IoUringRxConfig base;
+      return this->*x == base.*x;
+    };
+    return strcat(
+        RxConfig::toString(),
+        (!is_default(&IoUringRxConfig::fixed_files) ||
+         !is_default(&IoUringRxConfig::fixed_file_count))
+            ? strcat(
+                  " fixed_files=",
+                  fixed_files ? strcat("1 (count=", fixed_file_count, ")")
+                              : strcat("0"))
+            : "",
+        is_default(&IoUringRxConfig::provide_buffers)
+            ? ""
+            : strcat(" provide_buffers=", provide_buffers),
+        is_default(&IoUringRxConfig::provided_buffer_count)
+            ? ""
+            : strcat(" provided_buffer_count=", provided_buffer_count),
+        is_default(&IoUringRxConfig::provided_buffer_bitmap)
+            ? ""
+            : strcat(" provided_buffer_bitmap=", provided_buffer_bitmap),
+        is_default(&IoUringRxConfig::provided_buffer_sizes)
+            ? ""
+            : strcat(" provided_buffer_sizes=", provided_buffer_sizes),
+        is_default(&IoUringRxConfig::provided_buffer_max_groups)
+            ? ""
+            : strcat(
+                  " provided_buffer_max_groups=", provided_buffer_max_groups),
+        is_default(&IoUringRxConfig::provided_buffer_shrink_ms)
+            ? ""
+            : strcat(" provided_buffer_shrink_ms=", provided_buffer_shrink_ms),
+        is_default(&IoUringRxConfig::sqe_count)
+            ? ""
+            : strcat(" sqe_count=", sqe_count),
+        is_default(&IoUringRxConfig::cqe_count)
+            ? ""
+            : strcat(" cqe_count=", cqe_count),
+        is_default(&IoUringRxConfig::max_cqe_loop)
+            ? ""
+            : strcat(" max_cqe_loop=", max_cqe_loop),
+        is_default(&IoUringRxConfig::defer_taskrun)
+            ? ""
+            : strcat(" defer_taskrun=", defer_taskrun),
+        is_default(&IoUringRxConfig::specialize)
+            ? ""
+            : strcat(" specialize=", specialize),
+        is_default(&IoUringRxConfig::pbuf_ring_mmap)
+            ? ""
+            : strcat(" pbuf_ring_mmap=", pbuf_ring_mmap),
+        is_default(&IoUringRxConfig::no_mmap) ? "" : strcat(" no_mmap=", no_mmap),
+        is_default(&IoUringRxConfig::max_sends_in_flight)
+            ? ""
+            : strcat(" max_sends_in_flight=", max_sends_in_flight),
+        is_default(&IoUringRxConfig::multishot_recv)
+            ? ""
+            : strcat(" multishot_recv=", multishot_recv));
+  }
+};
+
+struct EpollRxConfig : RxConfig {
+  bool batch_send = false;
+  // TCP_ZEROCOPY_RECEIVE, mapping up to recv_size (page rounded) at a time
+  bool zerocopy_recv = false;
+  // stop reading a socket with this many bytes of responses unsent, until
+  // it catches up. 0 for no limit
+  size_t max_to_write = 0;
+
+  std::string const toString() const override {
+    // only give the important options:
+    auto is_default = [this](auto EpollRxConfig::*x) {
+      EpollRxConfig base;
+      return this->*x == base.*x;
+    };
+    return strcat(
+        RxConfig::toString(),
+        is_default(&EpollRxConfig::batch_send)
+            ? ""
+            : strcat(" batch_send=", batch_send),
+        is_default(&EpollRxConfig::zerocopy_recv)
+            ? ""
+            : strcat(" zerocopy_recv=", zerocopy_recv),
+        is_default(&EpollRxConfig::max_to_write)
+            ? ""
+            : strcat(" max_to_write=", max_to_write));
+  }
+};
+
+struct ProxyRxConfig : RxConfig {
+  // how bytes get from one socket to the other: copy, splice or io_uring
+  std::string strategy = "copy";
+  // where to forward to. if no port is given a local epoll receiver is run
+  std::string backend_host;
+  uint16_t backend_port = 0;
+  int pipe_size = 0;
+  int sqe_count = 64;
+  int provided_buffer_count = 8000;
+
+  std::string const toString() const override {
+    // only give the important options:
+    auto is_default = [this](auto ProxyRxConfig::*x) {
+      ProxyRxConfig base;
+      return this->*x == base.*x;
+    };
+    return strcat(
+        RxConfig::toString(),
+        " strategy=",
+        strategy,
+        is_default(&ProxyRxConfig::backend_port)
+            ? ""
+            : strcat(" backend=", backend_host, ":", backend_port),
+        is_default(&ProxyRxConfig::pipe_size)
+            ? ""
+            : strcat(" pipe_size=", pipe_size),
+        is_default(&ProxyRxConfig::provided_buffer_count)
+            ? ""
+            : strcat(" provided_buffer_count=", provided_buffer_count));
+  }
+};
@@ -0,0 +1,62 @@
+#include "rx_events.h"
+
+#include "util.h"
+
+std::string toString(RxEvent e) {
+  switch (e) {
+    case RxEvent::CqOverflow:
+      return "cq_overflow";
+    case RxEvent::Enobufs:
+      return "enobufs";
+    case RxEvent::LongCqeBatch:
+      return "long_cqe_batch";
+  }
+  return strcat("<BAD RxEvent ", (int)e, ">");
+}
+
+RxEventLog& RxEventLog::get() {
+  static RxEventLog log;
+  return log;
+}
+
+uint32_t RxEventLog::source(std::string const& name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  sources_.push_back(name);
+  return sources_.size() - 1;
+}
+
+void RxEventLog::add(uint32_t source, RxEvent event, uint64_t value) {
+  Entry e{TClock::now(), event, source, value};
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (entries_.size() < kCapacity) {
+    entries_.push_back(e);
+  } else {
+    entries_[next_] = e;
+    next_ = (next_ + 1) % kCapacity;
+  }
+}
+
+std::string RxEventLog::describe(
+    TClock::time_point from,
+    TClock::time_point to) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::string ret;
+  // oldest first
+  for (size_t i = 0; i < entries_.size(); i++) {
+    Entry const& e = entries_[(next_ + i) % entries_.size()];
+    if (e.at < from || e.at > to) {
+      continue;
+    }
+    ret += strcat(
+        ret.empty() ? "" : ", ",
+        toString(e.event),
+        "(",
+        e.value,
+        ")@",
+        std::chrono::duration_cast<std::chrono::microseconds>(e.at - from)
+            .count(),
+        "us ",
+        sources_.at(e.source));
+  }
+  return ret;
+}
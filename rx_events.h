@@ -0,0 +1,47 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// rare receiver events that can explain slow requests
+enum class RxEvent { CqOverflow, Enobufs, LongCqeBatch };
+
+std::string toString(RxEvent e);
+
+// process wide record of when RxEvents happened, shared by all the receivers
+// so that a local sender can line its slowest requests up against them. only
+// the most recent kCapacity are kept
+class RxEventLog {
+ public:
+  using TClock = std::chrono::steady_clock;
+  static constexpr size_t kCapacity = 65536;
+
+  struct Entry {
+    TClock::time_point at;
+    RxEvent event;
+    uint32_t source;
+    // the bgid for Enobufs, the count for LongCqeBatch
+    uint64_t value;
+  };
+
+  static RxEventLog& get();
+
+  // an id for a receiver, to pass to add()
+  uint32_t source(std::string const& name);
+
+  void add(uint32_t source, RxEvent event, uint64_t value = 0);
+
+  // "event(value)@offset name, ..." for the entries from..to, offsets
+  // relative to from
+  std::string describe(TClock::time_point from, TClock::time_point to) const;
+
+ private:
+  mutable std::mutex mutex_;
+  std::vector<std::string> sources_;
+  std::vector<Entry> entries_;
+  // next slot in entries_ once it is full
+  size_t next_ = 0;
+};
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <sys/times.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "time_series.h"
+#include "util.h"
+
+// per second receiver loop stats, logged as they go
+class RxStats {
+ public:
+  RxStats(
+      std::string const& name,
+      bool countReads,
+      TimeSeries* series = nullptr)
+      : name_(name), countReads_(countReads), series_(series) {
+    auto const now = std::chrono::steady_clock::now();
+    started_ = lastStats_ = now;
+    lastClock_ = checkedErrno(times(&lastTimes_), "initial times");
+    if (countReads_) {
+      reads_.reserve(32000);
+    }
+  }
+
+  void startWait() {
+    waitStarted_ = std::chrono::steady_clock::now();
+  }
+
+  void doneWait() {
+    auto now = std::chrono::steady_clock::now();
+    // anything under 100us seems to be very noisy
+    static constexpr std::chrono::microseconds kEpsilon{100};
+    if (now > waitStarted_ + kEpsilon) {
+      idle_ += (now - waitStarted_);
+    }
+  }
+
+  void doneLoop(
+      size_t bytes,
+      size_t requests,
+      unsigned int reads,
+      bool is_overflow = false) {
+    auto const now = std::chrono::steady_clock::now();
+    auto const duration = now - lastStats_;
+    ++loops_;
+
+    if (is_overflow) {
+      ++overflows_;
+      ++totalOverflows_;
+    }
+
+    if (series_) {
+      series_->sample(now, requests, bytes, totalOverflows_);
+    }
+
+    if (countReads_) {
+      reads_.push_back(reads);
+    }
+
+    if (duration >= std::chrono::seconds(1)) {
+      doLog(bytes, requests, now, duration);
+    }
+  }
+
+ private:
+  std::chrono::milliseconds getMs(clock_t from, clock_t to) {
+    return std::chrono::milliseconds(
+        to <= from ? 0llu : (((to - from) * 1000llu) / ticksPerSecond_));
+  }
+
+  template <size_t N>
+  int getReadStats(std::array<char, N>& arr) {
+    if (!reads_.size()) {
+      return 0;
+    }
+
+    std::sort(reads_.begin(), reads_.end());
+    size_t tot = std::accumulate(reads_.begin(), reads_.end(), size_t(0));
+    double avg = tot / (double)reads_.size();
+    unsigned int p10 = reads_[reads_.size() / 10];
+    unsigned int p50 = reads_[reads_.size() / 2];
+    unsigned int p90 = reads_[(int)(reads_.size() * 0.9)];
+    return snprintf(
+        arr.data(),
+        arr.size(),
+        " read_per_loop: p10=%u p50=%u p90=%u avg=%.2f",
+        p10,
+        p50,
+        p90,
+        avg);
+  }
+
+  void doLog(
+      size_t bytes,
+      size_t requests,
+      std::chrono::steady_clock::time_point now,
+      std::chrono::steady_clock::duration duration) {
+    using namespace std::chrono;
+    uint64_t const millis = duration_cast<milliseconds>(duration).count();
+    double bps = ((bytes - lastBytes_) * 1000.0) / millis;
+    double rps = ((requests - lastRequests_) * 1000.0) / millis;
+    struct tms times_now {};
+    clock_t clock_now = checkedErrno(::times(&times_now), "loop times");
+
+    // proxies that cannot see requests only have bytes to go on
+    if ((requests > lastRequests_ && lastRps_) ||
+        (bytes > lastBytes_ && lastBps_)) {
+      char buff[2048];
+      // use snprintf as I like the floating point formatting
+      int written = snprintf(
+          buff,
+          sizeof(buff),
+          "%s: rps:%6.2fk Bps:%6.2fM idle=%lums "
+          "user=%lums system=%lums wall=%lums loops=%lu overflows=%lu",
+          name_.c_str(),
+          rps / 1000.0,
+          bps / 1000000.0,
+          duration_cast<milliseconds>(idle_).count(),
+          getMs(lastTimes_.tms_utime, times_now.tms_utime).count(),
+          getMs(lastTimes_.tms_stime, times_now.tms_stime).count(),
+          getMs(lastClock_, clock_now).count(),
+          loops_,
+          overflows_);
+      if (written >= 0) {
+        std::array<char, 2048> read_stats_buf;
+        std::string_view read_stats;
+        if (countReads_) {
+          read_stats = std::string_view(
+              read_stats_buf.data(), getReadStats(read_stats_buf));
+          reads_.clear();
+        }
+
+        log(std::string_view(buff, written), read_stats);
+      }
+    }
+    loops_ = overflows_ = 0;
+    idle_ = steady_clock::duration{0};
+    lastClock_ = clock_now;
+    lastTimes_ = times_now;
+    lastBytes_ = bytes;
+    lastRequests_ = requests;
+    lastStats_ = now;
+    lastRps_ = rps;
+    lastBps_ = bps;
+  }
+
+ private:
+  std::string const& name_;
+  bool const countReads_;
+  TimeSeries* const series_;
+  std::vector<unsigned int> reads_;
+  std::chrono::steady_clock::time_point started_ =
+      std::chrono::steady_clock::now();
+  std::chrono::steady_clock::time_point lastStats_ =
+      std::chrono::steady_clock::now();
+
+  std::chrono::steady_clock::time_point waitStarted;
+  std::chrono::steady_clock::duration totalWaited{0};
+  uint64_t ticksPerSecond_ = sysconf(_SC_CLK_TCK);
+  struct tms lastTimes_;
+  clock_t lastClock_;
+  uint64_t loops_ = 0;
+  uint64_t overflows_ = 0;
+  uint64_t totalOverflows_ = 0;
+
+  std::chrono::steady_clock::time_point waitStarted_;
+  std::chrono::steady_clock::duration idle_{0};
+  size_t lastBytes_ = 0;
+  size_t lastRequests_ = 0;
+  size_t lastRps_ = 0;
+  size_t lastBps_ = 0;
+};
@@ -2,20 +2,25 @@
 #include <boost/program_options.hpp>
 #include <boost/thread/barrier.hpp>
 #include <algorithm>
+#include <cmath>
 #include <deque>
 #include <numeric>
 #include <thread>
 
 #include <arpa/inet.h>
+#include <linux/errqueue.h>
 #include <liburing.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <stdlib.h>
 #include <sys/epoll.h>
 #include <sys/fcntl.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <unistd.h>
 
+#include "perf_counters.h"
 #include "socket.h"
 
 namespace po = boost::program_options;
@@ -69,79 +74,60 @@ std::string toString(SenderState s) {
 
 int constexpr kPreludeSize = 8;
 
-LatencyResult LatencyResult::from(
-    std::vector<std::chrono::microseconds>&& durations) {
-  LatencyResult ret;
-  if (durations.size() == 0) {
-    return ret;
-  }
-  std::sort(durations.begin(), durations.end());
-  size_t const count = durations.size();
-  ret.count = count;
-  ret.p100 = durations.back();
-  ret.p95 = durations[(int)(durations.size() * 0.95)];
-  ret.p50 = durations[durations.size() / 2];
-  ret.avg =
-      std::accumulate(
-          durations.begin(), durations.end(), std::chrono::microseconds(0)) /
-      durations.size();
-  return ret;
+namespace {
+bool slowerThan(SlowRequest const& a, SlowRequest const& b) {
+  return a.total() > b.total();
 }
+} // namespace
 
-void LatencyResult::mergeIn(LatencyResult&& l) {
-  double const new_count = count + l.count;
-  if (new_count <= 0) {
+std::string SlowRequest::toString() const {
+  using namespace std::chrono;
+  auto us = [this](TClock::time_point t) {
+    return t == TClock::time_point{}
+        ? std::string("-")
+        : strcat(duration_cast<microseconds>(t - queued).count(), "us");
+  };
+  return strcat(
+      "total=",
+      duration_cast<microseconds>(total()).count(),
+      "us conn=",
+      connection,
+      " size=",
+      size,
+      " loop=",
+      loop,
+      " sent=",
+      us(sent),
+      " first_byte=",
+      us(first_byte),
+      " done=",
+      us(done),
+      rx_events.empty() ? "" : strcat(" rx={", rx_events, "}"));
+}
+
+void SlowestRequests::add(SlowRequest&& r) {
+  if (!wants(r.total())) {
     return;
   }
-  auto upd = [&](std::chrono::microseconds& self,
-                 std::chrono::microseconds const& other) {
-    // todo rounding maybe?
-    int64_t us =
-        (self.count() * this->count + other.count() * l.count) / new_count;
-    self = std::chrono::microseconds{us};
-  };
-  upd(p100, l.p100);
-  upd(p95, l.p95);
-  upd(p50, l.p50);
-  upd(avg, l.avg);
-  count = new_count;
+  if (heap_.size() == k_) {
+    std::pop_heap(heap_.begin(), heap_.end(), slowerThan);
+    heap_.pop_back();
+  }
+  heap_.push_back(std::move(r));
+  std::push_heap(heap_.begin(), heap_.end(), slowerThan);
 }
 
-LatencyResult LatencyResult::avgMerge(std::vector<LatencyResult> const& bs) {
-  LatencyResult ret;
-  if (bs.empty()) {
-    return ret;
+void SlowestRequests::mergeIn(SlowestRequests&& o) {
+  k_ = std::max(k_, o.k_);
+  for (auto& r : o.heap_) {
+    add(std::move(r));
   }
-  for (auto& b : bs) {
-    ret.p100 += b.p100;
-    ret.p95 += b.p95;
-    ret.p50 += b.p50;
-    ret.avg += b.avg;
-    ret.count += b.count;
-  }
-  ret.p100 /= bs.size();
-  ret.p95 /= bs.size();
-  ret.p50 /= bs.size();
-  ret.avg /= bs.size();
-  ret.count /= (double)bs.size();
-  return ret;
 }
 
-std::string LatencyResult::toString() const {
-  return strcat(
-      "p95=",
-      p95.count(),
-      "us",
-      " p50=",
-      p50.count(),
-      "us",
-      " avg=",
-      avg.count(),
-      "us",
-      " p100=",
-      p100.count(),
-      "us count=",
-      count);
+std::vector<SlowRequest> SlowestRequests::sorted() const {
+  std::vector<SlowRequest> ret = heap_;
+  std::sort(ret.begin(), ret.end(), slowerThan);
+  return ret;
 }
 
 class BurstStatCollector {
@@ -182,10 +168,66 @@ struct Action {
   uint64_t param;
 };
 
+// a finished action, handed back to the scenario in batches
+struct Completion {
+  uint64_t idx;
+  ActionOp op;
+  bool error;
+  int res;
+};
+
+// fifo of actions in one contiguous power of two sized ring, which grows when
+// full. avoids the per chunk allocations of a deque
+class ActionQueue {
+ public:
+  ActionQueue() : ring_(16) {}
+
+  template <class... Args>
+  void emplace_back(Args&&... args) {
+    if (size_ == ring_.size()) {
+      grow();
+    }
+    ring_[(head_ + size_) & (ring_.size() - 1)] =
+        Action(std::forward<Args>(args)...);
+    ++size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  // moves up to max actions from the front into out
+  size_t take(Action* out, size_t max) {
+    size_t const n = std::min(max, size_);
+    size_t const mask = ring_.size() - 1;
+    for (size_t i = 0; i < n; i++) {
+      out[i] = ring_[(head_ + i) & mask];
+    }
+    head_ = (head_ + n) & mask;
+    size_ -= n;
+    return n;
+  }
+
+ private:
+  void grow() {
+    std::vector<Action> bigger(ring_.size() * 2);
+    take(bigger.data(), size_);
+    size_ = ring_.size();
+    head_ = 0;
+    ring_ = std::move(bigger);
+  }
+
+  std::vector<Action> ring_;
+  size_t head_ = 0;
+  size_t size_ = 0;
+};
+
 class IBenchmarkScenario {
  public:
   virtual ~IBenchmarkScenario() = default;
-  virtual bool getAction(Action& a) = 0;
+  // fills out with up to max actions to run next, returning how many
+  virtual size_t getActions(Action* out, size_t max) = 0;
+  virtual void doneBatch(Completion const* done, size_t n) = 0;
   virtual void doneLast(uint64_t idx, ActionOp op) = 0;
   virtual void doneError(uint64_t idx, ActionOp op, int error) = 0;
   virtual std::vector<LatencyResult> burstResults() const {
@@ -194,6 +236,9 @@ class IBenchmarkScenario {
   virtual std::optional<LatencyResult> sendLatencies() const {
     return {};
   }
+  virtual std::optional<LatencyResult> correctedSendLatencies() const {
+    return {};
+  }
 
   virtual void parseMore(std::vector<std::string> const& split_args) {
     if (split_args.size() != 1) {
@@ -202,28 +247,39 @@ class IBenchmarkScenario {
   }
 };
 
+// TScenario must be final, so that doneBatch dispatches to its doneLast and
+// doneError without a virtual call per completion
+template <class TScenario>
 class BenchmarkScenarioBase : public IBenchmarkScenario {
  public:
-  bool getAction(Action& out) override {
-    if (queue.empty())
-      return false;
-    out = std::move(queue.front());
-    queue.pop_front();
-    return true;
+  size_t getActions(Action* out, size_t max) override {
+    return queue.take(out, max);
+  }
+
+  void doneBatch(Completion const* done, size_t n) override {
+    auto* self = static_cast<TScenario*>(this);
+    for (size_t i = 0; i < n; i++) {
+      if (done[i].error) {
+        self->doneError(done[i].idx, done[i].op, done[i].res);
+      } else {
+        self->doneLast(done[i].idx, done[i].op);
+      }
+    }
   }
 
   void doneError(uint64_t idx, ActionOp op, int error) override {}
 
  protected:
-  std::deque<Action> queue;
+  ActionQueue queue;
 };
 
-class ConnectSendLots : public BenchmarkScenarioBase {
+class ConnectSendLots final : public BenchmarkScenarioBase<ConnectSendLots> {
  public:
   ConnectSendLots(PerSendOptions const& per_options)
       : conns_(per_options.per_thread),
         sendSize_(per_options.size),
-        respSize_(per_options.resp) {
+        respSize_(per_options.resp),
+        coInterval_(per_options.co_interval_us) {
     for (uint64_t c = 1; c <= conns_; c++) {
       queue.emplace_back(Action(ActionOp::Connect, c));
     }
@@ -258,25 +314,39 @@ class ConnectSendLots : public BenchmarkScenarioBase {
   }
 
   std::optional<LatencyResult> sendLatencies() const override {
+    return LatencyResult::fromKeepingSamples(sendTimesUs());
+  }
+
+  std::optional<LatencyResult> correctedSendLatencies() const override {
+    if (!coInterval_.count()) {
+      return {};
+    }
+    return LatencyResult::fromKeepingSamples(
+        correctCoordinatedOmission(sendTimesUs(), coInterval_));
+  }
+
+ private:
+  std::vector<std::chrono::microseconds> sendTimesUs() const {
     using namespace std::chrono;
     std::vector<microseconds> m;
     m.reserve(sendTimes_.size());
     for (auto const& s : sendTimes_) {
       m.push_back(duration_cast<microseconds>(s));
     }
-    return LatencyResult::from(std::move(m));
+    return m;
   }
 
- private:
   bool startTiming_ = false;
   uint64_t conns_;
   uint64_t sendSize_;
   uint64_t respSize_;
+  std::chrono::microseconds coInterval_;
   std::vector<std::optional<TClock::time_point>> lastSend_;
   std::vector<TClock::duration> sendTimes_;
 };
 
-class ConnectSendDisconnect : public BenchmarkScenarioBase {
+class ConnectSendDisconnect final
+    : public BenchmarkScenarioBase<ConnectSendDisconnect> {
  public:
   ConnectSendDisconnect(
       PerSendOptions const& per_options,
@@ -340,7 +410,7 @@ TClock::time_point fromWaitParam(uint64_t val) {
   return getEpoch() + std::chrono::microseconds(val);
 }
 
-class BurstySend : public BenchmarkScenarioBase {
+class BurstySend final : public BenchmarkScenarioBase<BurstySend> {
  public:
   BurstySend(PerSendOptions const& per_options)
       : conns_(per_options.per_thread),
@@ -408,7 +478,8 @@ class BurstySend : public BenchmarkScenarioBase {
   BurstStatCollector stats_;
 };
 
-class BurstySendPeriodic : public BenchmarkScenarioBase {
+class BurstySendPeriodic final
+    : public BenchmarkScenarioBase<BurstySendPeriodic> {
  public:
   BurstySendPeriodic(
       PerSendOptions const& per_options,
@@ -523,12 +594,40 @@ class BurstySendPeriodic : public BenchmarkScenarioBase {
   BurstStatCollector stats_;
 };
 
+// bulk throughput: every connection sends back to back with no response
+class StreamSend final : public BenchmarkScenarioBase<StreamSend> {
+ public:
+  StreamSend(PerSendOptions const& per_options)
+      : conns_(per_options.per_thread), sendSize_(per_options.size) {
+    for (uint64_t c = 1; c <= conns_; c++) {
+      queue.emplace_back(Action(ActionOp::Connect, c));
+    }
+    queue.emplace_back(Action(ActionOp::Ready, 0));
+  }
+
+  void doneLast(uint64_t idx, ActionOp op) override {
+    switch (op) {
+      case ActionOp::Connect:
+      case ActionOp::Send:
+        queue.emplace_back(ActionOp::Send, idx, sendSize_);
+        break;
+      default:
+        break;
+    };
+  }
+
+ private:
+  uint64_t conns_;
+  uint64_t sendSize_;
+};
+
 std::vector<std::string> allScenarios() {
   return {
       "io_uring",
       "io_uring_single",
       "burst",
       "burst_periodic",
+      "stream",
   };
 }
 
@@ -553,6 +652,8 @@ std::unique_ptr<IBenchmarkScenario> makeScenario(
   } else if (test == "burst_periodic") {
     ret = std::make_unique<BurstySendPeriodic>(
         per_options, std::chrono::microseconds(1000));
+  } else if (test == "stream") {
+    ret = std::make_unique<StreamSend>(per_options);
   } else {
     die("unknown test ", test_args);
   }
@@ -560,13 +661,56 @@ std::unique_ptr<IBenchmarkScenario> makeScenario(
   return ret;
 }
 
+// whole requests (prelude and payload) in an unlinked tmpfs file, to be sent
+// with sendfile or splice rather than from SendBuffers
+struct FileSource {
+  FileSource(uint32_t size, uint32_t resp) : size(size + kPreludeSize) {
+    char path[] = "/dev/shm/netbench_source_XXXXXX";
+    fd = checkedErrno(mkstemp(path), "mkstemp ", path);
+    unlink(path);
+    std::vector<char> contents(this->size);
+    std::array<uint32_t, 2> lens{{size, resp}};
+    memcpy(contents.data(), lens.data(), sizeof(lens));
+    for (size_t done = 0; done < contents.size();) {
+      done += checkedErrno(
+          pwrite(fd, contents.data() + done, contents.size() - done, done),
+          "source pwrite");
+    }
+  }
+  ~FileSource() {
+    close(fd);
+  }
+  FileSource(FileSource const&) = delete;
+  FileSource& operator=(FileSource const&) = delete;
+
+  int fd;
+  size_t const size;
+};
+
+// one request from a FileSource at a time, through a pipe
+struct PipeSplicer {
+  PipeSplicer() {
+    checkedErrno(pipe2(pipe, O_NONBLOCK), "source pipe");
+  }
+  ~PipeSplicer() {
+    close(pipe[0]);
+    close(pipe[1]);
+  }
+  PipeSplicer(PipeSplicer const&) = delete;
+  PipeSplicer& operator=(PipeSplicer const&) = delete;
+
+  int pipe[2];
+  // bytes moved into the pipe not yet moved to the socket
+  size_t in_pipe = 0;
+};
+
 struct Connection {
-  explicit Connection(uint64_t id) : id(id) {
+  Connection(uint64_t id, BufferOptions const& buffer_opts)
+      : id(id), recv_buff(64, buffer_opts) {
     memset(&msg, 0, sizeof(struct msghdr));
     msg.msg_name = NULL;
     msg.msg_namelen = 0;
     msg.msg_iov = &iovs[0];
-    recv_buff.resize(64);
   }
 
   uint64_t id;
@@ -576,26 +720,69 @@ struct Connection {
 
   uint32_t whole_write = 0;
   void const* write_at = NULL;
+  // phases of the current request, only for the time series and the slowest
+  // requests
+  TClock::time_point request_start;
+  TClock::time_point send_done;
+  TClock::time_point first_byte;
 
   int connectRetries = 0;
 
   bool want_close = false;
-  std::vector<char> recv_buff;
+  Buffer recv_buff;
 
   struct msghdr msg;
   struct iovec iovs[2];
+
+  // only used when timestamping
+  SocketTimestamps ts;
+  uint64_t send_queued_ns = 0;
+  struct msghdr rxmsg;
+  struct iovec rxiov;
+  std::array<char, SocketTimestamps::kControlSize> control;
+
+  // only used with a splice source. splice_out: the last splice queued was
+  // from the pipe to the socket
+  std::unique_ptr<PipeSplicer> splicer;
+  bool splice_out = false;
 };
 
 struct SendBuffers {
-  explicit SendBuffers(size_t size) {
-    buff_.resize(size);
-  }
-  std::vector<char> const& buff() const {
+  SendBuffers(size_t size, BufferOptions const& opts) : buff_(size, opts) {}
+  Buffer const& buff() const {
     return buff_;
   }
-  std::vector<char> buff_;
+  Buffer buff_;
 };
 
+
+void fillCpu(
+    SendResults& res,
+    size_t bytes_sent,
+    size_t requests_sent,
+    ThreadCpu::Usage const& u) {
+  res.bytesSent = bytes_sent;
+  res.requestsSent = requests_sent;
+  res.cpuSeconds = std::chrono::duration<double>(u.cpu).count();
+  res.cycles = u.cycles;
+  res.dtlbMisses = u.dtlb_misses;
+  res.pageFaults = u.page_faults;
+}
+
+void fillLoad(
+    SendResults& res,
+    double run_seconds,
+    ThreadCpu::Usage const& u,
+    TClock::duration waiting,
+    size_t loops,
+    size_t full_loops) {
+  res.senderThreads = 1;
+  res.maxThreadCpu = std::chrono::duration<double>(u.cpu).count() / run_seconds;
+  res.minThreadWaiting =
+      std::chrono::duration<double>(waiting).count() / run_seconds;
+  res.maxOutstandingFull = loops ? (double)full_loops / loops : 0.0;
+}
+
 class ISender {
  public:
   virtual ~ISender() = default;
@@ -609,13 +796,16 @@ class Sender : public ISender {
       GlobalSendOptions const& options,
       PerSendOptions const& per_options,
       SendBuffers const& buffers,
+      FileSource const* source,
       uint16_t port,
       boost::barrier& ready_barrier)
       : cfg_(options),
         perCfg_(per_options),
         buffers(buffers),
+        source_(source),
         scenario(makeScenario(test, options, per_options)),
-        ready_barrier(ready_barrier) {
+        ready_barrier(ready_barrier),
+        slowest_(per_options.slowest) {
     struct io_uring_params params;
     memset(&params, 0, sizeof(params));
     params.flags = IORING_SETUP_CQSIZE;
@@ -623,6 +813,13 @@ class Sender : public ISender {
     checkedErrno(
         io_uring_queue_init_params(64, &ring_, &params),
         "io_uring_queue_init_params");
+    if (perCfg_.loop != "wait") {
+      // saves an fget/fput on every io_uring_enter
+      int ret = io_uring_register_ring_fd(&ring_);
+      if (ret < 0) {
+        vlog("sender: io_uring_register_ring_fd failed ", ret);
+      }
+    }
 
     std::string dest = cfg_.host;
     if (cfg_.ipv6) {
@@ -669,6 +866,13 @@ class Sender : public ISender {
       end_ = TClock::now() +
           std::chrono::milliseconds(
                  static_cast<uint64_t>(cfg_.run_seconds * 1000.0));
+      cpu_.start();
+      entersAtStart_ = enters_;
+      if (cfg_.series_interval_ms) {
+        series_ = TimeSeries(
+            std::chrono::milliseconds(cfg_.series_interval_ms),
+            TClock::now());
+      }
       scenario->doneLast(0, ActionOp::Ready);
       state_ = SenderState::Running;
     }
@@ -691,13 +895,20 @@ class Sender : public ISender {
           return false;
         }
       case SenderState::Preparing:
-      case SenderState::Running: {
-        Action a;
-        if (scenario->getAction(a)) {
-          runAction(a);
+      case SenderState::Running:
+        if (actionsAt_ == actionsEnd_) {
+          // only take what can be run now, the scenario may still change its
+          // mind about the rest
+          size_t const room = std::min<size_t>(
+              actions_.size(), cfg_.maxOutstanding - outstanding_);
+          actionsAt_ = 0;
+          actionsEnd_ = scenario->getActions(actions_.data(), room);
+        }
+        if (actionsAt_ < actionsEnd_) {
+          runAction(actions_[actionsAt_++]);
           return true;
         }
-      } break;
+        break;
     }
     return false;
   }
@@ -708,7 +919,8 @@ class Sender : public ISender {
       if (!create) {
         return nullptr;
       }
-      it = connections.emplace_hint(it, idx, std::make_unique<Connection>(idx));
+      it = connections.emplace_hint(
+          it, idx, std::make_unique<Connection>(idx, perCfg_.buffers));
     }
     return it->second.get();
   }
@@ -762,6 +974,7 @@ class Sender : public ISender {
 
   void submit() {
     while (expected_) {
+      ++enters_;
       int got = io_uring_submit(&ring_);
       if (got != expected_) {
         // log("sender: expected to submit ", expected_, " but did ", got);
@@ -779,7 +992,11 @@ class Sender : public ISender {
       int type = cfg_.ipv6 ? PF_INET6 : PF_INET;
       connection->fd = checkedErrno(socket(type, SOCK_STREAM, 0));
     }
-    if (cfg_.zero_send_buf) {
+    if (source_ && !connection->splicer) {
+      connection->splicer = std::make_unique<PipeSplicer>();
+    }
+    // a tiny send buffer would make streaming measure nothing but wakeups
+    if (cfg_.zero_send_buf && !perCfg_.stream) {
       doSetSockOpt<int>(connection->fd, SOL_SOCKET, SO_SNDBUF, 0);
     }
     auto* sqe = get_sqe();
@@ -788,7 +1005,33 @@ class Sender : public ISender {
     io_uring_sqe_set_data(sqe, (void*)connection->id);
   }
 
+  // io_uring has no sendfile, so any file source goes file -> pipe -> socket
+  void queueSplice(Connection* connection) {
+    PipeSplicer& sp = *connection->splicer;
+    auto* sqe = get_sqe();
+    connection->splice_out = sp.in_pipe > 0;
+    if (connection->splice_out) {
+      io_uring_prep_splice(
+          sqe, sp.pipe[0], -1, connection->fd, -1, sp.in_pipe, SPLICE_F_MOVE);
+    } else {
+      // the pipe is non blocking so this stops when it is full
+      io_uring_prep_splice(
+          sqe,
+          source_->fd,
+          connection->whole_write - connection->remaining,
+          sp.pipe[1],
+          -1,
+          connection->remaining,
+          SPLICE_F_MOVE);
+    }
+    io_uring_sqe_set_data(sqe, (void*)connection->id);
+  }
+
   void queueSend(Connection* connection) {
+    if (connection->splicer) {
+      queueSplice(connection);
+      return;
+    }
     size_t idx = 0;
     connection->msg.msg_iovlen = 1;
     size_t to_send = connection->remaining;
@@ -808,12 +1051,32 @@ class Sender : public ISender {
     auto* sqe = get_sqe();
     connection->iovs[idx].iov_base = (void*)connection->write_at;
     connection->iovs[idx].iov_len = to_send;
-    io_uring_prep_sendmsg(sqe, connection->fd, &connection->msg, MSG_NOSIGNAL);
+    if (perCfg_.timestamping) {
+      connection->send_queued_ns = SocketTimestamps::nowNs();
+    }
+    if (perCfg_.zerocopy) {
+      // the pages are pinned until the notification. the payload buffer is
+      // never written and the prelude is rewritten with the same values, so
+      // there is no need to hold off on the next send until then
+      io_uring_prep_sendmsg_zc(
+          sqe, connection->fd, &connection->msg, MSG_NOSIGNAL);
+      ++zerocopySends_;
+    } else {
+      io_uring_prep_sendmsg(
+          sqe, connection->fd, &connection->msg, MSG_NOSIGNAL);
+    }
     io_uring_sqe_set_data(sqe, (void*)connection->id);
   }
 
   void queueNewSend(Connection* connection, uint32_t length) {
+    if (series_.enabled() || slowest_.enabled()) {
+      connection->request_start = TClock::now();
+      connection->send_done = connection->first_byte = {};
+    }
     connection->whole_write = connection->remaining = length + kPreludeSize;
+    if (source_ && source_->size != connection->whole_write) {
+      die("file source has ", source_->size, " bytes but sending ", length);
+    }
     connection->write_at = buffers.buff().data();
     uint32_t* as_int = (uint32_t*)connection->recv_buff.data();
     as_int[0] = length;
@@ -827,8 +1090,21 @@ class Sender : public ISender {
     }
     connection->remaining = length;
     auto* sqe = get_sqe();
-    io_uring_prep_recv(
-        sqe, connection->fd, connection->recv_buff.data(), length, 0);
+    if (perCfg_.timestamping) {
+      // need the cmsgs for the rx timestamps
+      struct msghdr& m = connection->rxmsg;
+      memset(&m, 0, sizeof(m));
+      connection->rxiov.iov_base = connection->recv_buff.data();
+      connection->rxiov.iov_len = length;
+      m.msg_iov = &connection->rxiov;
+      m.msg_iovlen = 1;
+      m.msg_control = connection->control.data();
+      m.msg_controllen = connection->control.size();
+      io_uring_prep_recvmsg(sqe, connection->fd, &m, 0);
+    } else {
+      io_uring_prep_recv(
+          sqe, connection->fd, connection->recv_buff.data(), length, 0);
+    }
     io_uring_sqe_set_data(sqe, (void*)connection->id);
   }
 
@@ -875,21 +1151,36 @@ class Sender : public ISender {
         } else {
           // connected no problem
           successConnects_++;
+          if (perCfg_.timestamping) {
+            // tcp refuses OPT_ID until connected
+            SocketTimestamps::enable(connection->fd);
+          }
         }
         break;
       case ActionOp::Recv:
+        if (slowest_.enabled() && res > 0 &&
+            connection->first_byte == TClock::time_point{}) {
+          connection->first_byte = TClock::now();
+        }
+        if (perCfg_.timestamping && res > 0) {
+          SocketTimestamps::readRx(&connection->rxmsg, timestamps_);
+          connection->ts.drainErrQueue(connection->fd, timestamps_);
+        }
         // we didn't change the old state
         if (res <= 0) {
           vlog("recv bad read: ", res);
           recvErrors_++;
           waserror = true;
         } else if ((size_t)res < connection->remaining) {
+          statsFinishedRead(res);
           connection->remaining -= res;
           queueRecv(connection, connection->remaining);
           finished = false;
         } else {
           // finished
+          statsFinishedRead(res);
           connection->remaining = 0;
+          requestDone(connection);
           if (perCfg_.workload) {
             runWorkload(1, perCfg_.workload);
           }
@@ -912,13 +1203,31 @@ class Sender : public ISender {
           }
           sendErrors_++;
           connection->remaining = 0;
+        } else if (connection->splicer) {
+          PipeSplicer& sp = *connection->splicer;
+          if (!connection->splice_out) {
+            sp.in_pipe = res;
+          } else {
+            sp.in_pipe -= std::min<size_t>(sp.in_pipe, res);
+            connection->remaining -=
+                std::min<size_t>(connection->remaining, res);
+          }
+          if (connection->remaining > 0) {
+            queueSend(connection);
+            finished = false;
+          } else {
+            sendDone(connection);
+          }
         } else if (res > 0) {
+          if (perCfg_.timestamping) {
+            connection->ts.sent(res, connection->send_queued_ns);
+          }
           connection->remaining -= std::min<size_t>(connection->remaining, res);
           if (connection->remaining > 0) {
             queueSend(connection);
             finished = false;
           } else {
-            statsFinishedWrite(res);
+            sendDone(connection);
           }
         }
         break;
@@ -939,11 +1248,10 @@ class Sender : public ISender {
       return;
     }
 
+    // the scenario hears about these in one batch per processCompletions
+    completed_.push_back(Completion{connection->id, was, waserror, res});
     if (waserror) {
-      scenario->doneError(connection->id, was, res);
       connection->want_close = true;
-    } else {
-      scenario->doneLast(connection->id, was);
     }
 
     if (kill) {
@@ -954,16 +1262,60 @@ class Sender : public ISender {
     }
   }
 
+  void sendDone(Connection* connection) {
+    statsFinishedWrite(connection->whole_write);
+    if (slowest_.enabled()) {
+      connection->send_done = TClock::now();
+    }
+  }
+
+  // the whole response has arrived
+  void requestDone(Connection* connection) {
+    if (state_ != SenderState::Running ||
+        !(series_.enabled() || slowest_.enabled())) {
+      return;
+    }
+    auto const now = TClock::now();
+    auto const total = now - connection->request_start;
+    series_.addLatency(
+        std::chrono::duration_cast<std::chrono::microseconds>(total));
+    if (slowest_.wants(total)) {
+      SlowRequest r;
+      r.connection = connection->id;
+      r.size = connection->whole_write;
+      r.loop = loops_;
+      r.queued = connection->request_start;
+      r.sent = connection->send_done;
+      r.first_byte = connection->first_byte;
+      r.done = now;
+      slowest_.add(std::move(r));
+    }
+  }
+
   void processCqe(struct io_uring_cqe* cqe) {
     if (cqe->user_data == LIBURING_UDATA_TIMEOUT) {
       io_uring_cqe_seen(&ring_, cqe);
       return;
     }
 
+    if (cqe->flags & IORING_CQE_F_NOTIF) {
+      // zero copy send is done with the buffer
+      if (cqe->res & IORING_NOTIF_USAGE_ZC_COPIED) {
+        ++zerocopyCopied_;
+      }
+      io_uring_cqe_seen(&ring_, cqe);
+      outstanding_--;
+      return;
+    }
+
     Connection* connection = tryGetConnection(cqe->user_data, false);
     int res = cqe->res;
+    // F_MORE: a notification will follow, so this is still outstanding
+    bool const more = cqe->flags & IORING_CQE_F_MORE;
     io_uring_cqe_seen(&ring_, cqe);
-    outstanding_--;
+    if (!more) {
+      outstanding_--;
+    }
     if (connection) {
       processRes(connection, res);
     } else {
@@ -971,7 +1323,8 @@ class Sender : public ISender {
     }
   }
 
-  void processCompletions() {
+  // how long to wait for completions before checking on waits_
+  struct __kernel_timespec waitTimeout() const {
     struct __kernel_timespec timeout;
     if (waits_.size()) {
       auto now = TClock::now();
@@ -992,11 +1345,69 @@ class Sender : public ISender {
       timeout.tv_sec = 1;
       timeout.tv_nsec = 0;
     }
+    return timeout;
+  }
 
-    struct io_uring_cqe* cqes[1024];
+  void processCompletions() {
+    struct __kernel_timespec timeout = waitTimeout();
+    struct io_uring_cqe* cqe;
+    if (!io_uring_cq_ready(&ring_)) {
+      ++enters_;
+    }
+    auto const start = TClock::now();
     checkedErrno(
-        io_uring_wait_cqe_timeout(&ring_, &cqes[0], &timeout),
+        io_uring_wait_cqe_timeout(&ring_, &cqe, &timeout),
         "sender processCompletions");
+    waited(start);
+    reapCompletions(timeout);
+  }
+
+  // time spent waiting for completions while running
+  void waited(TClock::time_point start) {
+    if (state_ == SenderState::Running) {
+      waiting_ += TClock::now() - start;
+    }
+  }
+
+  // submits and waits in one io_uring_enter
+  void submitAndWait() {
+    if (!expected_ && io_uring_cq_ready(&ring_)) {
+      reapCompletions({});
+      return;
+    }
+    struct __kernel_timespec timeout = waitTimeout();
+    struct io_uring_cqe* cqe;
+    unsigned const ready = io_uring_sq_ready(&ring_);
+    ++enters_;
+    auto const start = TClock::now();
+    int ret =
+        io_uring_submit_and_wait_timeout(&ring_, &cqe, 1, &timeout, nullptr);
+    waited(start);
+    if (ret < 0 && ret != -ETIME && ret != -EINTR) {
+      checkedErrno(ret, "sender io_uring_submit_and_wait_timeout");
+    }
+    int const got = ready - io_uring_sq_ready(&ring_);
+    outstanding_ += got;
+    expected_ -= got;
+    reapCompletions(timeout);
+  }
+
+  // submits, then spins on the CQ without entering the kernel until there is
+  // something to do
+  void submitAndPoll() {
+    submit();
+    auto const timeout = waitTimeout();
+    auto const start = TClock::now();
+    auto const until = start + std::chrono::seconds(timeout.tv_sec) +
+        std::chrono::nanoseconds(timeout.tv_nsec);
+    while (!io_uring_cq_ready(&ring_) && TClock::now() < until) {
+    }
+    waited(start);
+    reapCompletions(timeout);
+  }
+
+  void reapCompletions(struct __kernel_timespec const& timeout) {
+    struct io_uring_cqe* cqes[1024];
     int cqe_count =
         io_uring_peek_batch_cqe(&ring_, cqes, sizeof(cqes) / sizeof(cqes[0]));
     if (!cqe_count && waits_.empty()) {
@@ -1016,6 +1427,10 @@ class Sender : public ISender {
       processCqe(cqes[i]);
     }
     uint64_t const waits_processed = processWaits(TClock::now());
+    if (!completed_.empty()) {
+      scenario->doneBatch(completed_.data(), completed_.size());
+      completed_.clear();
+    }
     if (!cqe_count && !waits_.empty() && !waits_processed) {
       vlog(
           "should have processed some waits: slept for ",
@@ -1051,33 +1466,66 @@ class Sender : public ISender {
         res = {};
         res.packetsPerSecond = packetsSent_ / cfg_.run_seconds;
         res.bytesPerSecond = bytesSent_ / cfg_.run_seconds;
+        res.rxBytesPerSecond = bytesRecv_ / cfg_.run_seconds;
         res.sendErrors = sendErrors_;
         res.recvErrors = recvErrors_;
         res.connectErrors = connectErrors_;
         res.connects = successConnects_;
+        auto const cpu = cpu_.sample();
+        fillCpu(res, bytesSent_, packetsSent_, cpu);
+        fillLoad(res, cfg_.run_seconds, cpu, waiting_, loops_, fullLoops_);
+        res.zerocopySends = zerocopySends_;
+        res.zerocopyCopied = zerocopyCopied_;
+        res.enters = enters_ - entersAtStart_;
+        res.series = std::move(series_);
+        series_ = {};
+        res.slowest = std::move(slowest_);
+        slowest_ = SlowestRequests{};
       }
       if (state_ == SenderState::Closing && connections.empty()) {
         state_ = SenderState::Closed;
         break;
       }
+      if (state_ == SenderState::Running) {
+        series_.sample(
+            TClock::now(),
+            packetsSent_,
+            bytesSent_,
+            sendErrors_ + recvErrors_ + connectErrors_);
+        ++loops_;
+        if (outstanding_ >= cfg_.maxOutstanding) {
+          ++fullLoops_;
+        }
+      }
 
       while (1) {
         while (queueOne())
           ;
-        if (expected_) {
+        if (perCfg_.loop != "wait") {
+          // submitted along with waiting for completions
+          break;
+        } else if (expected_) {
           submit();
         } else {
           break;
         }
       }
 
-      processCompletions();
+      if (perCfg_.loop == "submit_and_wait") {
+        submitAndWait();
+      } else if (perCfg_.loop == "busy_poll") {
+        submitAndPoll();
+      } else {
+        processCompletions();
+      }
     }
 
     // these happen here as some sends seem to take an absolute age, and we want
     // to know about them in the stats (p100 for example)
     res.latencies = scenario->sendLatencies().value_or(LatencyResult{});
+    res.correctedLatencies = scenario->correctedSendLatencies();
     res.burstResults = scenario->burstResults();
+    res.timestamps = std::move(timestamps_);
     return res;
   }
 
@@ -1089,6 +1537,13 @@ class Sender : public ISender {
     bytesSent_ += size;
   }
 
+  void statsFinishedRead(int size) {
+    if (state_ != SenderState::Running) {
+      return;
+    }
+    bytesRecv_ += size;
+  }
+
  private:
   void maybeTooManyConnectErrors() {
     // bail out early
@@ -1107,6 +1562,7 @@ class Sender : public ISender {
   GlobalSendOptions const cfg_;
   PerSendOptions const perCfg_;
   SendBuffers const& buffers;
+  FileSource const* source_;
   std::unique_ptr<IBenchmarkScenario> scenario;
   boost::barrier& ready_barrier;
   std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections;
@@ -1119,13 +1575,33 @@ class Sender : public ISender {
   TClock::time_point end_;
   std::vector<uint64_t> toClose;
   std::map<TClock::time_point, WaitData> waits_;
+  // actions taken from the scenario but not run yet, and completions not yet
+  // passed back to it
+  std::array<Action, 64> actions_;
+  size_t actionsAt_ = 0;
+  size_t actionsEnd_ = 0;
+  std::vector<Completion> completed_;
 
   size_t bytesSent_ = 0;
+  size_t bytesRecv_ = 0;
   size_t packetsSent_ = 0;
   size_t connectErrors_ = 0;
   size_t sendErrors_ = 0;
   size_t recvErrors_ = 0;
   size_t successConnects_ = 0;
+  size_t zerocopySends_ = 0;
+  size_t zerocopyCopied_ = 0;
+  // io_uring_enter calls (or the ones that would have been, without a cqe
+  // already waiting)
+  size_t enters_ = 0;
+  size_t entersAtStart_ = 0;
+  TClock::duration waiting_{0};
+  TimeSeries series_;
+  SlowestRequests slowest_;
+  size_t loops_ = 0;
+  size_t fullLoops_ = 0;
+  TimestampStats timestamps_;
+  ThreadCpu cpu_;
 };
 
 void getAddress(
@@ -1136,6 +1612,9 @@ void getAddress(
   getAddress(options.host, options.ipv6, port, addr, addrLen);
 }
 
+// what an epoll sender connection does wrong, see PerSendOptions
+enum class Fault { None, Reset, HalfClose, Stall, SlowReader };
+
 struct EpollConnection {
   explicit EpollConnection(int fd) : fd(fd) {}
   EpollConnection(EpollConnection const&) = delete;
@@ -1159,61 +1638,102 @@ struct EpollConnection {
   ssize_t toSend = 0;
   size_t toRecv = 0;
   TClock::time_point last;
+  // only kept for the slowest requests
+  TClock::time_point queued;
+  TClock::time_point first_byte;
   std::vector<std::chrono::microseconds> latencies;
+  SocketTimestamps ts;
+  std::unique_ptr<PipeSplicer> splicer;
+  Fault fault = Fault::None;
 };
 
 class EpollSender : public ISender {
  public:
-  std::vector<char> buff;
-  std::vector<char> rxbuff;
+  Buffer buff;
+  Buffer rxbuff;
   EpollSender(
       GlobalSendOptions const& options,
       PerSendOptions const& per_opts,
+      FileSource const* source,
       uint16_t port,
       boost::barrier& ready_barrier,
       uint32_t size)
-      : cfg_(options), perCfg_(per_opts), ready_barrier(ready_barrier) {
+      : cfg_(options),
+        perCfg_(per_opts),
+        source_(source),
+        ready_barrier(ready_barrier),
+        slowest_(per_opts.slowest) {
     getAddress(options, port, &addr_, &addrLen_);
     latencies_.reserve(perCfg_.per_thread * 10000);
     epollFd_ = checkedErrno(epoll_create(2048), "epoll_create");
 
     // prep buffer
-    buff.resize(sizeof(uint32_t) * 2 + size);
-    rxbuff.resize(std::min<size_t>(1024, per_opts.resp));
+    buff = Buffer(sizeof(uint32_t) * 2 + size, per_opts.buffers);
+    rxbuff = Buffer(std::min<size_t>(1024, per_opts.resp), per_opts.buffers);
     std::array<uint32_t, 2> lens;
     lens[0] = size;
     lens[1] = perCfg_.resp;
     memcpy(buff.data(), lens.data(), sizeof(lens));
+    if (perCfg_.slow_fraction > 0) {
+      // slow readers send their whole pipeline of requests at once
+      slowBuff_ = Buffer(buff.size() * perCfg_.slow_pipeline, per_opts.buffers);
+      for (size_t at = 0; at < slowBuff_.size(); at += buff.size()) {
+        memcpy(slowBuff_.data() + at, buff.data(), buff.size());
+      }
+      slowChunk_ = std::clamp<size_t>(
+          perCfg_.slow_read_bytes_per_sec / 100, 1, rxbuff.size());
+      slowPause_ = std::chrono::duration_cast<TClock::duration>(
+          std::chrono::duration<double>(
+              (double)slowChunk_ / perCfg_.slow_read_bytes_per_sec));
+    }
   }
 
   ~EpollSender() {
     close(epollFd_);
   }
 
-  bool addConnection() {
+  // a connected non blocking socket
+  int connectSocket() {
     int type = cfg_.ipv6 ? PF_INET6 : PF_INET;
     int fd = checkedErrno(socket(type, SOCK_STREAM, 0));
-    auto conn = std::make_unique<EpollConnection>(fd);
-    if (cfg_.zero_send_buf) {
-      doSetSockOpt<int>(conn->fd, SOL_SOCKET, SO_SNDBUF, 0);
+    if (cfg_.zero_send_buf && !perCfg_.stream) {
+      doSetSockOpt<int>(fd, SOL_SOCKET, SO_SNDBUF, 0);
+    }
+    if (perCfg_.zerocopy) {
+      doSetSockOpt<int>(fd, SOL_SOCKET, SO_ZEROCOPY, 1);
     }
     checkedErrno(
-        ::connect(conn->fd, (const struct sockaddr*)&addr_, addrLen_),
+        ::connect(fd, (const struct sockaddr*)&addr_, addrLen_),
         "sender: epoll_connect");
+    if (perCfg_.timestamping) {
+      SocketTimestamps::enable(fd);
+    }
 
     // now make it non blocking:
     {
-      int flags = checkedErrno(fcntl(conn->fd, F_GETFL, 0));
+      int flags = checkedErrno(fcntl(fd, F_GETFL, 0));
       flags |= O_NONBLOCK;
-      checkedErrno(fcntl(conn->fd, F_SETFL, flags));
+      checkedErrno(fcntl(fd, F_SETFL, flags));
     }
+    return fd;
+  }
 
+  void addEpoll(int fd, uint32_t i) {
     struct epoll_event ev;
     memset(&ev, 0, sizeof(ev));
-    ev.events = EPOLLIN;
-    ev.data.u32 = connections_.size();
+    // nothing comes back when streaming, so only wait for space to send
+    ev.events = perCfg_.stream ? EPOLLOUT : EPOLLIN;
+    ev.data.u32 = i;
     checkedErrno(
-        epoll_ctl(epollFd_, EPOLL_CTL_ADD, conn->fd, &ev), "sender: epoll_add");
+        epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev), "sender: epoll_add");
+  }
+
+  bool addConnection() {
+    auto conn = std::make_unique<EpollConnection>(connectSocket());
+    if (source_ && perCfg_.source == "splice") {
+      conn->splicer = std::make_unique<PipeSplicer>();
+    }
+    addEpoll(conn->fd, connections_.size());
     connections_.push_back(std::move(conn));
     return true;
   }
@@ -1228,11 +1748,34 @@ class EpollSender : public ISender {
         "sender: epoll_add_write");
   }
 
+  // the first connections are the faulty ones
+  Fault faultFor(int i) const {
+    double const n = perCfg_.per_thread;
+    double faulty = perCfg_.reset_fraction;
+    if (i < std::lround(n * faulty)) {
+      return Fault::Reset;
+    }
+    faulty += perCfg_.half_close_fraction;
+    if (i < std::lround(n * faulty)) {
+      return Fault::HalfClose;
+    }
+    faulty += perCfg_.stall_fraction;
+    if (i < std::lround(n * faulty)) {
+      return Fault::Stall;
+    }
+    faulty += perCfg_.slow_fraction;
+    if (i < std::lround(n * faulty)) {
+      return Fault::SlowReader;
+    }
+    return Fault::None;
+  }
+
   void doConnect() {
     for (int i = 0; i < perCfg_.per_thread; i++) {
       std::this_thread::sleep_for(
           std::chrono::microseconds(100 * perCfg_.threads));
       if (addConnection()) {
+        connections_.back()->fault = faultFor(i);
         successConnects_++;
       } else {
         connectErrors_++;
@@ -1246,16 +1789,27 @@ class EpollSender : public ISender {
     if (!conn) {
       log("cannot send on ", i);
     }
+    bool const slow = conn->fault == Fault::SlowReader;
     if (!from_poll) {
-      conn->toSendAt = buff.data();
-      conn->toSend = buff.size();
+      conn->toSendAt = slow ? slowBuff_.data() : buff.data();
+      conn->toSend = slow ? slowBuff_.size() : buff.size();
+      // a long pipeline gets responses before it is all sent
+      conn->toRecv = perCfg_.resp * (slow ? perCfg_.slow_pipeline : 1);
+      if (slowest_.enabled()) {
+        conn->queued = TClock::now();
+        conn->first_byte = {};
+      }
     }
     do {
-      int ret = ::send(conn->fd, conn->toSendAt, conn->toSend, MSG_NOSIGNAL);
+      int ret = sendSome(conn, MSG_NOSIGNAL);
+      if (ret > 0 && perCfg_.timestamping) {
+        conn->ts.sent(ret);
+      }
       if (ret >= 0) {
         if (ret >= conn->toSend) {
           break;
         }
+        conn->toSendAt += ret;
         conn->toSend -= ret;
       } else {
         int e = errno;
@@ -1271,36 +1825,225 @@ class EpollSender : public ISender {
         }
       }
     } while (conn->toSend);
+    conn->toSend = 0;
+    conn->sent(TClock::now());
+    if (conn->fault != Fault::None) {
+      sentFaulty(i, from_poll);
+      return;
+    }
     if (from_poll) {
       modEpoll(conn, i, EPOLLIN);
     }
-    conn->toRecv = perCfg_.resp;
-    conn->sent(TClock::now());
     ++packetsSent_;
     bytesSent_ += buff.size();
   }
 
+  void sentFaulty(uint32_t i, bool from_poll) {
+    EpollConnection* conn = connections_[i].get();
+    if (conn->fault == Fault::SlowReader) {
+      faultyRequests_ += perCfg_.slow_pipeline;
+    } else {
+      ++faultyRequests_;
+    }
+    if (conn->fault == Fault::HalfClose) {
+      // the response should still come back, then the receiver's close
+      checkedErrno(shutdown(conn->fd, SHUT_WR), "sender: shutdown");
+      ++halfCloses_;
+    } else if (conn->fault == Fault::Stall) {
+      // leave the response unread, so it backs up into the receiver
+      ++stalls_;
+      stallEnds_.emplace_back(conn->last + stallFor_, i);
+      modEpoll(conn, i, 0);
+      return;
+    }
+    if (from_poll) {
+      modEpoll(conn, i, EPOLLIN);
+    }
+  }
+
+  // the next fault on a connection, reconnecting first if it was closed
+  void resume(uint32_t i) {
+    EpollConnection* conn = connections_[i].get();
+    if (conn->fd < 0) {
+      conn->fd = connectSocket();
+      addEpoll(conn->fd, i);
+      successConnects_++;
+    }
+    if (conn->fault != Fault::Reset) {
+      doSend(i, false);
+      return;
+    }
+    // part of a request, and then a RST rather than a FIN. a fresh socket
+    // has room for it, and if not the reset is still mid request
+    ::send(
+        conn->fd,
+        buff.data(),
+        std::max<size_t>(1, buff.size() / 2),
+        MSG_NOSIGNAL | MSG_DONTWAIT);
+    doSetSockOpt<struct linger>(
+        conn->fd, SOL_SOCKET, SO_LINGER, linger{.l_onoff = 1, .l_linger = 0});
+    ++resets_;
+    closeFaulty(i);
+  }
+
+  void closeFaulty(uint32_t i) {
+    EpollConnection* conn = connections_[i].get();
+    checkedErrno(
+        epoll_ctl(epollFd_, EPOLL_CTL_DEL, conn->fd, NULL), "sender: epoll_del");
+    close(conn->fd);
+    conn->fd = -1;
+    conn->toSend = 0;
+    conn->toRecv = 0;
+    resumes_.emplace_back(TClock::now() + faultInterval_, i);
+  }
+
+  // a whole response arrived on a faulty connection
+  void respondedFaulty(uint32_t i) {
+    // half-closed connections wait for the receiver to close them
+    if (connections_[i]->fault == Fault::Stall) {
+      resumes_.emplace_back(TClock::now() + faultInterval_, i);
+    } else if (connections_[i]->fault == Fault::SlowReader) {
+      // straight on to the next pipeline of requests
+      resume(i);
+    }
+  }
+
+  // one slowChunk_ of the responses, then nothing for slowPause_
+  bool doSlowRead(uint32_t i) {
+    EpollConnection* conn = connections_[i].get();
+    ssize_t ret;
+    do {
+      ret = ::recv(conn->fd, rxbuff.data(), slowChunk_, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0 && errno == EAGAIN) {
+      return false;
+    } else if (ret <= 0) {
+      closeFaulty(i);
+      return false;
+    } else if ((size_t)ret > conn->toRecv) {
+      die("too much data, wanted only ", conn->toRecv, " got ", ret);
+    }
+    ++slowReadCount_;
+    conn->toRecv -= ret;
+    // carry on with any of the pipeline still to send
+    modEpoll(conn, i, conn->toSend ? EPOLLOUT : 0);
+    slowReadEnds_.emplace_back(TClock::now() + slowPause_, i);
+    return conn->toRecv == 0;
+  }
+
+  // each is in time order as each has a fixed delay
+  void processFaultTimers(TClock::time_point now) {
+    while (!stallEnds_.empty() && stallEnds_.front().first <= now) {
+      uint32_t const i = stallEnds_.front().second;
+      stallEnds_.pop_front();
+      modEpoll(connections_[i].get(), i, EPOLLIN);
+    }
+    while (!slowReadEnds_.empty() && slowReadEnds_.front().first <= now) {
+      uint32_t const i = slowReadEnds_.front().second;
+      slowReadEnds_.pop_front();
+      EpollConnection* conn = connections_[i].get();
+      // it may have been closed and be waiting to reconnect
+      if (conn->fd >= 0) {
+        modEpoll(conn, i, conn->toSend ? EPOLLIN | EPOLLOUT : EPOLLIN);
+      }
+    }
+    while (!resumes_.empty() && resumes_.front().first <= now) {
+      uint32_t const i = resumes_.front().second;
+      resumes_.pop_front();
+      resume(i);
+    }
+  }
+
+  // send from buff, or the same bytes from the file source. buff has the same
+  // layout as the file, so toSendAt gives the file offset
+  ssize_t sendSome(EpollConnection* conn, int flags) {
+    if (!source_) {
+      return ::send(conn->fd, conn->toSendAt, conn->toSend, flags);
+    }
+    off_t off = conn->toSendAt - buff.data();
+    if (!conn->splicer) {
+      return ::sendfile(conn->fd, source_->fd, &off, conn->toSend);
+    }
+    PipeSplicer& sp = *conn->splicer;
+    if (!sp.in_pipe) {
+      ssize_t got = splice(
+          source_->fd,
+          &off,
+          sp.pipe[1],
+          NULL,
+          conn->toSend,
+          SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if (got <= 0) {
+        return got;
+      }
+      sp.in_pipe = got;
+    }
+    ssize_t ret = splice(
+        sp.pipe[0],
+        NULL,
+        conn->fd,
+        NULL,
+        sp.in_pipe,
+        SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (ret > 0) {
+      sp.in_pipe -= ret;
+    }
+    return ret;
+  }
+
   bool doRead(int i) {
     EpollConnection* conn = connections_[i].get();
     if (!conn) {
       log("cannot recv on ", i);
       return false;
     }
+    if (conn->fault == Fault::SlowReader) {
+      return doSlowRead(i);
+    }
     int e;
     do {
-      int ret = ::recv(conn->fd, rxbuff.data(), rxbuff.size(), 0);
+      int ret;
+      if (perCfg_.timestamping) {
+        ret = recvTimestamped(conn);
+      } else {
+        ret = ::recv(conn->fd, rxbuff.data(), rxbuff.size(), 0);
+      }
       if (ret > 0) {
+        bytesRecv_ += ret;
+        if (slowest_.enabled() && conn->toRecv == perCfg_.resp) {
+          conn->first_byte = TClock::now();
+        }
         if ((size_t)ret > conn->toRecv) {
           die("too much data, wanted only ", conn->toRecv, " got ", ret);
         } else if ((size_t)ret == conn->toRecv) {
           conn->toRecv = 0;
-          latencies_.push_back(conn->recv(TClock::now()));
+          if (conn->fault != Fault::None) {
+            return true;
+          }
+          auto const now = TClock::now();
+          latencies_.push_back(conn->recv(now));
+          series_.addLatency(latencies_.back());
+          if (slowest_.wants(now - conn->queued)) {
+            SlowRequest r;
+            r.connection = i;
+            r.size = buff.size();
+            r.loop = loops_;
+            r.queued = conn->queued;
+            r.sent = conn->last;
+            r.first_byte = conn->first_byte;
+            r.done = now;
+            slowest_.add(std::move(r));
+          }
           return true;
         } else {
           conn->toRecv -= ret;
           return false;
         }
       } else if (ret == 0) {
+        if (conn->fault != Fault::None) {
+          closeFaulty(i);
+          return false;
+        }
         connections_[i].reset();
         log("connection ", i, " closed");
       } else {
@@ -1308,6 +2051,11 @@ class EpollSender : public ISender {
         if (e == EAGAIN) {
           return false;
         }
+        if (conn->fault != Fault::None && e != EINTR) {
+          // likely reset by a receiver closing with our request unread
+          closeFaulty(i);
+          return false;
+        }
         ++recvErrors_;
       }
     } while (e == EINTR);
@@ -1315,49 +2063,229 @@ class EpollSender : public ISender {
     return false;
   }
 
-  SendResults go() override {
-    SendResults res;
-    doConnect();
-    ready_barrier.wait();
-    end_ = TClock::now() +
-        std::chrono::milliseconds(
-               static_cast<uint64_t>(cfg_.run_seconds * 1000.0));
-    for (unsigned int i = 0; i < connections_.size(); i++) {
-      doSend(i, false);
+  // keep the socket full. level triggered EPOLLOUT brings us back here once
+  // there is space again
+  void doStream(uint32_t i) {
+    EpollConnection* conn = connections_[i].get();
+    if (!conn) {
+      return;
+    }
+    int const flags = MSG_NOSIGNAL | (perCfg_.zerocopy ? MSG_ZEROCOPY : 0);
+    // bounded so that one connection can't hog the loop
+    for (int sends = 0; sends < 16; sends++) {
+      if (!conn->toSend) {
+        conn->toSendAt = buff.data();
+        conn->toSend = buff.size();
+      }
+      ssize_t ret = sendSome(conn, flags);
+      if (ret < 0) {
+        int e = errno;
+        // ENOBUFS: too many zero copy sends waiting on completions
+        if (e == EAGAIN || e == ENOBUFS) {
+          return;
+        } else if (e == EINTR) {
+          continue;
+        }
+        sendErrors_++;
+        die("stream send error ", e);
+      }
+      if (perCfg_.zerocopy) {
+        ++zerocopySends_;
+      }
+      bytesSent_ += ret;
+      conn->toSendAt += ret;
+      conn->toSend -= ret;
+      if (!conn->toSend) {
+        ++packetsSent_;
+      }
+    }
+  }
+
+  // MSG_ZEROCOPY completions arrive on the error queue as ranges of send ids
+  void drainZerocopy(uint32_t i) {
+    EpollConnection* conn = connections_[i].get();
+    if (!conn) {
+      return;
+    }
+    std::array<char, 128> control;
+    while (true) {
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_control = control.data();
+      msg.msg_controllen = control.size();
+      if (::recvmsg(conn->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+        return;
+      }
+      for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+           cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+            !(cmsg->cmsg_level == SOL_IPV6 &&
+              cmsg->cmsg_type == IPV6_RECVERR)) {
+          continue;
+        }
+        struct sock_extended_err err;
+        memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+        if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+          continue;
+        }
+        if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+          zerocopyCopied_ += err.ee_data - err.ee_info + 1;
+        }
+      }
     }
+  }
+
+  void goStream() {
     std::array<struct epoll_event, 1024> epoll_events;
     while (TClock::now() < end_) {
+      auto const start = TClock::now();
       int nevents = checkedErrno(
           epoll_wait(epollFd_, epoll_events.data(), epoll_events.size(), 100),
           "epoll_wait");
+      auto const now = TClock::now();
+      waiting_ += now - start;
+      sampleSeries(now);
+      for (int i = 0; i < nevents; i++) {
+        uint32_t const idx = epoll_events[i].data.u32;
+        if (epoll_events[i].events & EPOLLERR) {
+          drainZerocopy(idx);
+        }
+        if (epoll_events[i].events & EPOLLOUT) {
+          doStream(idx);
+        }
+      }
+    }
+  }
+
+  void goRequestResponse() {
+    for (unsigned int i = 0; i < connections_.size(); i++) {
+      if (connections_[i]->fault == Fault::None) {
+        doSend(i, false);
+      } else {
+        resume(i);
+      }
+    }
+    // fault timers need waking up for
+    int const timeout_ms = perCfg_.faults() ? 1 : 100;
+    std::array<struct epoll_event, 1024> epoll_events;
+    while (TClock::now() < end_) {
+      auto const start = TClock::now();
+      int nevents = checkedErrno(
+          epoll_wait(
+              epollFd_, epoll_events.data(), epoll_events.size(), timeout_ms),
+          "epoll_wait");
+      auto const now = TClock::now();
+      waiting_ += now - start;
+      sampleSeries(now);
+      ++loops_;
       for (int i = 0; i < nevents; i++) {
+        uint32_t const idx = epoll_events[i].data.u32;
+        EpollConnection* conn = connections_[idx].get();
+        if (!conn || conn->fd < 0) {
+          continue;
+        }
         if (epoll_events[i].events & EPOLLIN) {
-          if (doRead(i)) {
+          if (doRead(idx)) {
+            if (conn->fault != Fault::None) {
+              respondedFaulty(idx);
+              continue;
+            }
             if (perCfg_.workload) {
               runWorkload(1, perCfg_.workload);
             }
-            doSend(i, false);
+            doSend(idx, false);
           }
         } else if (epoll_events[i].events & EPOLLOUT) {
-          doSend(i, true);
+          doSend(idx, true);
         }
       }
+      if (perCfg_.faults()) {
+        processFaultTimers(TClock::now());
+      }
+    }
+  }
+
+  SendResults go() override {
+    SendResults res;
+    doConnect();
+    ready_barrier.wait();
+    end_ = TClock::now() +
+        std::chrono::milliseconds(
+               static_cast<uint64_t>(cfg_.run_seconds * 1000.0));
+    cpu_.start();
+    if (cfg_.series_interval_ms) {
+      series_ = TimeSeries(
+          std::chrono::milliseconds(cfg_.series_interval_ms), TClock::now());
     }
+    if (perCfg_.stream) {
+      goStream();
+    } else {
+      goRequestResponse();
+    }
+    auto const cpu = cpu_.sample();
 
     // make the results now, so it doesnt include cleanup
     res = {};
+    fillCpu(res, bytesSent_, packetsSent_, cpu);
+    // one request in flight per connection, so never held back by
+    // maxOutstanding
+    fillLoad(res, cfg_.run_seconds, cpu, waiting_, 0, 0);
+    res.zerocopySends = zerocopySends_;
+    res.zerocopyCopied = zerocopyCopied_;
+    res.resets = resets_;
+    res.halfCloses = halfCloses_;
+    res.stalls = stalls_;
+    res.slowReads = slowReadCount_;
+    res.faultyRequests = faultyRequests_;
     res.packetsPerSecond = packetsSent_ / cfg_.run_seconds;
     res.bytesPerSecond = bytesSent_ / cfg_.run_seconds;
+    res.rxBytesPerSecond = bytesRecv_ / cfg_.run_seconds;
     res.sendErrors = sendErrors_;
     res.recvErrors = recvErrors_;
     res.connectErrors = connectErrors_;
     res.connects = successConnects_;
-    res.latencies = LatencyResult::from(std::move(latencies_));
+    if (perCfg_.co_interval_us) {
+      res.correctedLatencies =
+          LatencyResult::fromKeepingSamples(correctCoordinatedOmission(
+              latencies_, std::chrono::microseconds(perCfg_.co_interval_us)));
+    }
+    // threads' tails are merged from their samples
+    res.latencies = LatencyResult::fromKeepingSamples(std::move(latencies_));
     // res.burstResults = scenario->burstResults();
+    res.timestamps = std::move(timestamps_);
+    res.series = std::move(series_);
+    res.slowest = std::move(slowest_);
     return res;
   }
 
  private:
+  void sampleSeries(TClock::time_point now) {
+    series_.sample(
+        now,
+        packetsSent_,
+        bytesSent_,
+        sendErrors_ + recvErrors_ + connectErrors_);
+  }
+
+  int recvTimestamped(EpollConnection* conn) {
+    std::array<char, SocketTimestamps::kControlSize> control;
+    struct iovec iov;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = rxbuff.data();
+    iov.iov_len = rxbuff.size();
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+    int ret = ::recvmsg(conn->fd, &msg, 0);
+    if (ret > 0) {
+      SocketTimestamps::readRx(&msg, timestamps_);
+      conn->ts.drainErrQueue(conn->fd, timestamps_);
+    }
+    return ret;
+  }
+
   void maybeTooManyConnectErrors() {
     // bail out early
     if (connectErrors_ >= 100 && connectErrors_ > 100 * successConnects_) {
@@ -1370,6 +2298,7 @@ class EpollSender : public ISender {
 
   GlobalSendOptions const cfg_;
   PerSendOptions const perCfg_;
+  FileSource const* source_;
   boost::barrier& ready_barrier;
   struct sockaddr_storage addr_;
   socklen_t addrLen_;
@@ -1377,7 +2306,34 @@ class EpollSender : public ISender {
   int epollFd_;
   std::vector<std::unique_ptr<EpollConnection>> connections_;
   std::vector<std::chrono::microseconds> latencies_;
+  TimestampStats timestamps_;
+  ThreadCpu cpu_;
+  // in epoll_wait
+  TClock::duration waiting_{0};
+  TimeSeries series_;
+  SlowestRequests slowest_;
+  uint64_t loops_ = 0;
+  std::chrono::milliseconds const stallFor_{perCfg_.stall_ms};
+  std::chrono::milliseconds const faultInterval_{perCfg_.fault_interval_ms};
+  // faulty connections to stop stalling, and to resume (reconnecting if
+  // needed) at the given times
+  std::deque<std::pair<TClock::time_point, uint32_t>> stallEnds_;
+  std::deque<std::pair<TClock::time_point, uint32_t>> resumes_;
+  // slow readers: the requests they pipeline, and how much they read at a
+  // time, how often, and when they can next read
+  Buffer slowBuff_;
+  size_t slowChunk_ = 0;
+  TClock::duration slowPause_{0};
+  std::deque<std::pair<TClock::time_point, uint32_t>> slowReadEnds_;
+  size_t resets_ = 0;
+  size_t halfCloses_ = 0;
+  size_t stalls_ = 0;
+  size_t slowReadCount_ = 0;
+  size_t faultyRequests_ = 0;
+  size_t zerocopySends_ = 0;
+  size_t zerocopyCopied_ = 0;
   size_t bytesSent_ = 0;
+  size_t bytesRecv_ = 0;
   size_t packetsSent_ = 0;
   size_t connectErrors_ = 0;
   size_t sendErrors_ = 0;
@@ -1397,6 +2353,61 @@ std::pair<std::string, PerSendOptions> PerSendOptions::parseOptions(
 ("size", po::value(&cfg.size)->default_value(cfg.size))
 ("resp", po::value(&cfg.resp)->default_value(cfg.resp))
 ("workload", po::value(&cfg.workload)->default_value(cfg.workload))
+("timestamping", po::value(&cfg.timestamping)
+   ->default_value(cfg.timestamping),
+ "collect SO_TIMESTAMPING software rx/tx timestamps")
+("echo", po::value(&cfg.echo)->default_value(cfg.echo),
+ "receiver echoes the payload, so expect size bytes back")
+("zerocopy", po::value(&cfg.zerocopy)->default_value(cfg.zerocopy),
+ "send with MSG_ZEROCOPY (epoll_stream) or IORING_OP_SEND_ZC (io_uring)")
+("source", po::value(&cfg.source)->default_value(cfg.source),
+ "payload from: buffer, or a /dev/shm file with sendfile or splice")
+("co_interval_us", po::value(&cfg.co_interval_us)
+   ->default_value(cfg.co_interval_us),
+ "expected time between requests on a connection, to also report latency "
+ "corrected for coordinated omission (0 for off)")
+("slowest", po::value(&cfg.slowest)->default_value(cfg.slowest),
+ "report this many of the slowest requests over all threads, with when each "
+ "phase happened and any local receiver events at the time")
+("reset_fraction", po::value(&cfg.reset_fraction)
+   ->default_value(cfg.reset_fraction),
+ "fraction of connections that send part of a request and then reset "
+ "(epoll only)")
+("half_close_fraction", po::value(&cfg.half_close_fraction)
+   ->default_value(cfg.half_close_fraction),
+ "fraction of connections that half-close after writing a request "
+ "(epoll only)")
+("stall_fraction", po::value(&cfg.stall_fraction)
+   ->default_value(cfg.stall_fraction),
+ "fraction of connections that leave responses unread for stall_ms. use a "
+ "resp larger than the socket buffers to block the receiver (epoll only)")
+("stall_ms", po::value(&cfg.stall_ms)->default_value(cfg.stall_ms))
+("fault_interval_ms", po::value(&cfg.fault_interval_ms)
+   ->default_value(cfg.fault_interval_ms),
+ "time between faults on each faulty connection")
+("slow_fraction", po::value(&cfg.slow_fraction)
+   ->default_value(cfg.slow_fraction),
+ "fraction of connections that pipeline requests and read the responses "
+ "slowly (epoll only)")
+("slow_read_bytes_per_sec", po::value(&cfg.slow_read_bytes_per_sec)
+   ->default_value(cfg.slow_read_bytes_per_sec))
+("slow_pipeline", po::value(&cfg.slow_pipeline)
+   ->default_value(cfg.slow_pipeline),
+ "requests each slow connection keeps in flight")
+("loop", po::value(&cfg.loop)->default_value(cfg.loop),
+ "io_uring sender loop: wait (submit, then wait for completions), "
+ "submit_and_wait (one io_uring_enter for both) or busy_poll (submit, then "
+ "spin on the completion queue)")
+("huge_pages", po::value(&cfg.buffers.huge_pages)
+   ->default_value(cfg.buffers.huge_pages),
+ "back send and receive buffers with explicit 2MB huge pages")
+("thp", po::value(&cfg.buffers.thp)->default_value(cfg.buffers.thp),
+ "madvise(MADV_HUGEPAGE) send and receive buffers")
+("prefault", po::value(&cfg.buffers.prefault)
+   ->default_value(cfg.buffers.prefault),
+ "fault in send and receive buffers up front")
+("mlock", po::value(&cfg.buffers.mlock)->default_value(cfg.buffers.mlock),
+ "mlock send and receive buffers")
   ;
   // clang-format on
 
@@ -1407,6 +2418,56 @@ std::pair<std::string, PerSendOptions> PerSendOptions::parseOptions(
   auto e = splits[0];
 
   simpleParse(desc, splits);
+  if (cfg.echo) {
+    cfg.resp = cfg.size;
+  }
+  cfg.stream = e == "stream" || e == "epoll_stream";
+  if (cfg.stream) {
+    // a zero response size tells the receiver not to reply
+    cfg.resp = 0;
+  }
+  if (cfg.source != "buffer" && cfg.source != "sendfile" &&
+      cfg.source != "splice") {
+    die("unknown source ", cfg.source);
+  }
+  if (cfg.loop != "wait" && cfg.loop != "submit_and_wait" &&
+      cfg.loop != "busy_poll") {
+    die("unknown loop ", cfg.loop);
+  }
+  if (cfg.zerocopy && cfg.source != "buffer") {
+    die("zerocopy only applies to the buffer source");
+  }
+  if (cfg.zerocopy && e == "epoll") {
+    // only the streaming epoll sender reaps MSG_ZEROCOPY completions
+    die("epoll zerocopy is only supported by epoll_stream");
+  }
+  if (cfg.zerocopy && cfg.timestamping) {
+    // both are reported on the socket error queue
+    die("zerocopy and timestamping can not be used together");
+  }
+  for (double f :
+       {cfg.reset_fraction,
+        cfg.half_close_fraction,
+        cfg.stall_fraction,
+        cfg.slow_fraction}) {
+    if (f < 0 || f > 1) {
+      die("fault fractions must be between 0 and 1");
+    }
+  }
+  if (cfg.reset_fraction + cfg.half_close_fraction + cfg.stall_fraction +
+          cfg.slow_fraction >
+      1) {
+    die("fault fractions add up to more than 1");
+  }
+  if (cfg.slow_fraction > 0 &&
+      (!cfg.slow_read_bytes_per_sec || !cfg.slow_pipeline || !cfg.resp ||
+       cfg.source != "buffer")) {
+    die("slow readers need a read rate, a pipeline, responses and the "
+        "buffer source");
+  }
+  if (cfg.faults() && e != "epoll") {
+    die("fault injection is only supported by the epoll sender");
+  }
 
   return std::make_pair(e, cfg);
 }
@@ -1417,23 +2478,33 @@ SendResults runSender(
     uint16_t port) {
   auto [engine, per_opts] = PerSendOptions::parseOptions(test);
 
-  auto buffers = std::make_shared<SendBuffers>(per_opts.size);
+  auto buffers = std::make_shared<SendBuffers>(per_opts.size, per_opts.buffers);
+  std::shared_ptr<FileSource> source;
+  if (per_opts.source != "buffer") {
+    source = std::make_shared<FileSource>(per_opts.size, per_opts.resp);
+  }
   std::vector<SendResults> results;
   std::vector<std::thread> threads;
   boost::barrier ready_barrier{(unsigned int)per_opts.threads + 1};
   results.resize(per_opts.threads);
   for (int i = 0; i < per_opts.threads; i++) {
     std::unique_ptr<ISender> sender;
-    if (engine == "epoll") {
+    if (engine == "epoll" || engine == "epoll_stream") {
       sender = std::make_unique<EpollSender>(
-          options, per_opts, port, ready_barrier, per_opts.size);
+          options, per_opts, source.get(), port, ready_barrier, per_opts.size);
     } else {
       sender = std::make_unique<Sender>(
-          engine, options, per_opts, *buffers, port, ready_barrier);
+          engine,
+          options,
+          per_opts,
+          *buffers,
+          source.get(),
+          port,
+          ready_barrier);
     }
     threads.push_back(std::thread{wrapThread(
         strcat("send", i),
-        [i, buffers, s = std::move(sender), r = &results[i]]() {
+        [i, buffers, source, s = std::move(sender), r = &results[i]]() {
           *r = s->go();
           vlog("test ", i, " done with ", r->toString());
         })});
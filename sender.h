@@ -5,6 +5,11 @@
 #include <string>
 #include <vector>
 
+#include "buffers.h"
+#include "latency.h"
+#include "memory.h"
+#include "time_series.h"
+#include "timestamping.h"
 #include "util.h"
 
 struct GlobalSendOptions {
@@ -14,6 +19,8 @@ struct GlobalSendOptions {
   size_t response_size = 1;
   std::string host;
   bool ipv6 = true;
+  // interval for the tx and rx time series, 0 for none
+  uint64_t series_interval_ms = 1000;
 };
 
 struct PerSendOptions {
@@ -22,42 +29,209 @@ struct PerSendOptions {
   size_t size = 64;
   size_t resp = 64;
   size_t workload = 0;
+  bool timestamping = false;
+  // expect the receiver to echo the payload back, so resp becomes size
+  bool echo = false;
+  // bulk throughput: send continuously with no responses (set by scenario)
+  bool stream = false;
+  // MSG_ZEROCOPY (epoll_stream) or IORING_OP_SEND_ZC (io_uring) sends
+  bool zerocopy = false;
+  // where the payload comes from: buffer, or sendfile or splice from a file
+  // in /dev/shm. io_uring has no sendfile so uses splice for both
+  std::string source = "buffer";
+  // how the io_uring sender submits and waits: wait, submit_and_wait or
+  // busy_poll
+  std::string loop = "wait";
+  // backing for the send and receive buffers
+  BufferOptions buffers;
+  // expected time between requests on a connection. when set, latencies are
+  // also reported corrected for coordinated omission
+  uint64_t co_interval_us = 0;
+  // keep this many of the slowest requests, with their phases. each thread
+  // keeps its own and the merged result keeps the slowest overall
+  size_t slowest = 0;
+  // fault injection (epoll sender only): the fractions of connections that
+  // send part of a request and then reset (SO_LINGER 0), that half-close
+  // after writing a request, or that leave each response unread for
+  // stall_ms. resets and half-closes reconnect fault_interval_ms later, and
+  // stalls start again that long after their response is read. only the
+  // remaining healthy connections count towards throughput and latency
+  double reset_fraction = 0;
+  double half_close_fraction = 0;
+  double stall_fraction = 0;
+  uint64_t stall_ms = 100;
+  uint64_t fault_interval_ms = 10;
+  // slow consumers (epoll sender only): the fraction of connections that
+  // keep slow_pipeline requests in flight but only read the responses at
+  // slow_read_bytes_per_sec, to see if the receiver keeps them from holding
+  // up everyone else. also excluded from throughput and latency
+  double slow_fraction = 0;
+  uint64_t slow_read_bytes_per_sec = 65536;
+  uint32_t slow_pipeline = 16;
+  bool faults() const {
+    return reset_fraction > 0 || half_close_fraction > 0 ||
+        stall_fraction > 0 || slow_fraction > 0;
+  }
   static std::pair<std::string, PerSendOptions> parseOptions(std::string const& tx);
 };
 
-struct LatencyResult {
-  std::chrono::microseconds p100 = {};
-  std::chrono::microseconds p95 = {};
-  std::chrono::microseconds p50 = {};
-  std::chrono::microseconds avg = {};
-  double count = 0.0 /* avg count done per burst */;
+// one of the slowest requests, with when each of its phases happened
+struct SlowRequest {
+  using TClock = std::chrono::steady_clock;
+
+  uint64_t connection = 0;
+  size_t size = 0;
+  // sender loop iteration it finished on
+  uint64_t loop = 0;
+  TClock::time_point queued;
+  TClock::time_point sent;
+  TClock::time_point first_byte;
+  TClock::time_point done;
+  // receiver events while it was in flight, if the receiver was local
+  std::string rx_events;
 
-  static LatencyResult from(std::vector<std::chrono::microseconds>&& durations);
-  void mergeIn(LatencyResult&& l);
-  static LatencyResult avgMerge(std::vector<LatencyResult> const& bs);
+  TClock::duration total() const {
+    return done - queued;
+  }
   std::string toString() const;
 };
 
+// the k slowest requests seen, in a min heap on total()
+class SlowestRequests {
+ public:
+  SlowestRequests() = default;
+  explicit SlowestRequests(size_t k) : k_(k) {}
+
+  bool enabled() const {
+    return k_ > 0;
+  }
+
+  // cheap check before building a SlowRequest
+  bool wants(SlowRequest::TClock::duration total) const {
+    return enabled() && (heap_.size() < k_ || total > heap_.front().total());
+  }
+
+  void add(SlowRequest&& r);
+  void mergeIn(SlowestRequests&& o);
+
+  template <class F>
+  void forEach(F&& f) {
+    for (auto& r : heap_) {
+      f(r);
+    }
+  }
+
+  // slowest first
+  std::vector<SlowRequest> sorted() const;
+
+ private:
+  size_t k_ = 0;
+  std::vector<SlowRequest> heap_;
+};
+
 struct SendResults {
   double packetsPerSecond = 0;
   double bytesPerSecond = 0;
+  double rxBytesPerSecond = 0;
   size_t connects = 0;
   size_t connectErrors = 0;
   size_t sendErrors = 0;
   size_t recvErrors = 0;
   LatencyResult latencies;
+  // latencies corrected for coordinated omission, if asked for
+  std::optional<LatencyResult> correctedLatencies;
   std::vector<LatencyResult> burstResults;
+  TimestampStats timestamps;
+  // per interval requests (sent), bytes (sent), errors and request latency
+  TimeSeries series;
+  SlowestRequests slowest;
+  // bytes sent while running, and the sending threads' cpu use over the same
+  // period. cycles are only known if perf counters are available everywhere
+  size_t bytesSent = 0;
+  size_t requestsSent = 0;
+  double cpuSeconds = 0;
+  std::optional<uint64_t> cycles;
+  std::optional<uint64_t> dtlbMisses;
+  std::optional<uint64_t> pageFaults;
+  size_t zerocopySends = 0;
+  // zero copy sends that the kernel ended up copying anyway
+  size_t zerocopyCopied = 0;
+  // io_uring_enter calls by io_uring senders while running
+  size_t enters = 0;
+  // injected faults, and the requests sent on faulty connections (which are
+  // not in the throughput or latency)
+  size_t resets = 0;
+  size_t halfCloses = 0;
+  size_t stalls = 0;
+  size_t slowReads = 0;
+  size_t faultyRequests = 0;
+  // how hard the busiest sender thread worked, to tell whether the client
+  // rather than the receiver was the limit. cpu and waiting (blocked or
+  // polling for completions) are fractions of the run time, outstanding_full
+  // the fraction of loop iterations with maxOutstanding requests in flight
+  size_t senderThreads = 0;
+  double maxThreadCpu = 0;
+  double minThreadWaiting = 0;
+  double maxOutstandingFull = 0;
+  // process and socket memory over the whole test, including the receiver if
+  // it is local. not merged as it is already for all threads
+  std::optional<MemoryReport> memory;
 
   void mergeIn(SendResults&& b) {
+    // counters are only meaningful if every thread had them
+    auto merge_counter = [first = cpuSeconds == 0](
+                             std::optional<uint64_t>& to,
+                             std::optional<uint64_t> const& from) {
+      if (first) {
+        to = from;
+      } else if (to && from) {
+        *to += *from;
+      } else {
+        to.reset();
+      }
+    };
+    merge_counter(cycles, b.cycles);
+    merge_counter(dtlbMisses, b.dtlbMisses);
+    merge_counter(pageFaults, b.pageFaults);
+    if (!senderThreads) {
+      maxThreadCpu = b.maxThreadCpu;
+      minThreadWaiting = b.minThreadWaiting;
+      maxOutstandingFull = b.maxOutstandingFull;
+    } else if (b.senderThreads) {
+      maxThreadCpu = std::max(maxThreadCpu, b.maxThreadCpu);
+      minThreadWaiting = std::min(minThreadWaiting, b.minThreadWaiting);
+      maxOutstandingFull = std::max(maxOutstandingFull, b.maxOutstandingFull);
+    }
+    senderThreads += b.senderThreads;
+    bytesSent += b.bytesSent;
+    requestsSent += b.requestsSent;
+    cpuSeconds += b.cpuSeconds;
+    zerocopySends += b.zerocopySends;
+    zerocopyCopied += b.zerocopyCopied;
+    enters += b.enters;
+    resets += b.resets;
+    halfCloses += b.halfCloses;
+    stalls += b.stalls;
+    slowReads += b.slowReads;
+    faultyRequests += b.faultyRequests;
     packetsPerSecond += b.packetsPerSecond;
     bytesPerSecond += b.bytesPerSecond;
+    rxBytesPerSecond += b.rxBytesPerSecond;
     sendErrors += b.sendErrors;
     recvErrors += b.recvErrors;
     connectErrors += b.connectErrors;
     connects += b.connects;
     latencies.mergeIn(std::move(b.latencies));
+    if (correctedLatencies && b.correctedLatencies) {
+      correctedLatencies->mergeIn(std::move(*b.correctedLatencies));
+    } else if (b.correctedLatencies) {
+      correctedLatencies = std::move(b.correctedLatencies);
+    }
     burstResults.insert(
         burstResults.end(), b.burstResults.begin(), b.burstResults.end());
+    timestamps.mergeIn(std::move(b.timestamps));
+    series.mergeIn(std::move(b.series));
+    slowest.mergeIn(std::move(b.slowest));
   }
 
   std::string burstString() const {
@@ -72,7 +246,80 @@ struct SendResults {
     if (!latencies.count) {
       return {};
     }
-    return strcat(" latency={", latencies.toString(), "}");
+    return strcat(
+        " latency={",
+        latencies.toString(),
+        "}",
+        correctedLatencies
+            ? strcat(" correctedLatency={", correctedLatencies->toString(), "}")
+            : "");
+  }
+
+  std::string cpuString() const {
+    if (cpuSeconds <= 0 || !bytesSent) {
+      return {};
+    }
+    return strcat(
+        " gbitPerCore=",
+        (bytesSent * 8) / cpuSeconds / 1e9,
+        requestsSent
+            ? strcat(" cpuNsPerRequest=", cpuSeconds * 1e9 / requestsSent)
+            : "",
+        cycles ? strcat(" cyclesPerByte=", (double)*cycles / bytesSent) : "",
+        dtlbMisses ? strcat(" dtlbMissesPerMB=", *dtlbMisses * 1e6 / bytesSent)
+                   : "",
+        pageFaults ? strcat(" pageFaults=", *pageFaults) : "",
+        enters && requestsSent
+            ? strcat(" entersPerRequest=", (double)enters / requestsSent)
+            : "");
+  }
+
+  // a sender thread that hardly ever waits for completions, or is mostly
+  // held back by maxOutstanding, limits the result
+  bool saturated() const {
+    return senderThreads &&
+        (minThreadWaiting < 0.05 || maxOutstandingFull > 0.5);
+  }
+
+  std::string loadString() const {
+    if (!senderThreads) {
+      return {};
+    }
+    return strcat(
+        " senderCpu=",
+        (int)(maxThreadCpu * 100),
+        "% senderWaiting=",
+        (int)(minThreadWaiting * 100),
+        "% senderOutstandingFull=",
+        (int)(maxOutstandingFull * 100),
+        "%",
+        saturated() ? " SENDER_SATURATED" : "");
+  }
+
+  std::string zerocopyString() const {
+    if (!zerocopySends) {
+      return {};
+    }
+    return strcat(
+        " zerocopySends=", zerocopySends, " zerocopyCopied=", zerocopyCopied);
+  }
+
+  std::string faultString() const {
+    if (!faultyRequests && !resets) {
+      return {};
+    }
+    return strcat(
+        " faults={resets=",
+        resets,
+        " halfCloses=",
+        halfCloses,
+        " stalls=",
+        stalls,
+        " slowReads=",
+        slowReads,
+        " faultyRequests=",
+        faultyRequests,
+        "}");
   }
 
   std::string toString() const {
@@ -81,6 +328,8 @@ struct SendResults {
         leftpad(strcat((int)(packetsPerSecond / 1000)), 7),
         "k bytesPerSecond=",
         leftpad(strcat((int)(bytesPerSecond / 1000000)), 5),
+        "M rxBytesPerSecond=",
+        leftpad(strcat((int)(rxBytesPerSecond / 1000000)), 5),
         "M connectErrors=",
         connectErrors,
         " sendErrors=",
@@ -90,7 +339,13 @@ struct SendResults {
         " connects=",
         connects,
         latencyString(),
-        burstString());
+        burstString(),
+        cpuString(),
+        loadString(),
+        zerocopyString(),
+        faultString(),
+        timestamps.toString(),
+        memory ? memory->toString() : "");
   }
 };
 
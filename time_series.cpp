@@ -0,0 +1,114 @@
+#include "time_series.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+
+#include "util.h"
+
+TimeSeries::TimeSeries(
+    std::chrono::milliseconds interval,
+    TClock::time_point start)
+    : interval_(interval), nextEnd_(start + interval) {}
+
+void TimeSeries::setPercentiles(Point& p) {
+  auto const& l = p.latencies;
+  if (!l.empty()) {
+    p.p50 = l[l.size() / 2];
+    p.p99 = l[(size_t)(l.size() * 0.99)];
+    p.p100 = l.back();
+  }
+}
+
+void TimeSeries::closeIntervals(
+    TClock::time_point now,
+    size_t requests,
+    size_t bytes,
+    size_t errors) {
+  // everything so far was seen before the interval ended, as it is sampled
+  // every loop
+  Point p;
+  p.requests = requests - lastRequests_;
+  p.bytes = bytes - lastBytes_;
+  p.errors = errors - lastErrors_;
+  std::sort(latencies_.begin(), latencies_.end());
+  p.latencies = std::move(latencies_);
+  latencies_.clear();
+  setPercentiles(p);
+  points_.push_back(std::move(p));
+  nextEnd_ += interval_;
+  // nothing was seen in intervals that passed without a sample (a stall), so
+  // they stay empty
+  while (now >= nextEnd_) {
+    points_.emplace_back();
+    nextEnd_ += interval_;
+  }
+  lastRequests_ = requests;
+  lastBytes_ = bytes;
+  lastErrors_ = errors;
+}
+
+void TimeSeries::mergeIn(TimeSeries&& o) {
+  if (!enabled()) {
+    *this = std::move(o);
+    return;
+  }
+  if (o.points_.size() > points_.size()) {
+    points_.resize(o.points_.size());
+  }
+  for (size_t i = 0; i < o.points_.size(); i++) {
+    Point& p = points_[i];
+    Point const& q = o.points_[i];
+    p.requests += q.requests;
+    p.bytes += q.bytes;
+    p.errors += q.errors;
+    if (q.latencies.empty()) {
+      continue;
+    }
+    std::vector<std::chrono::microseconds> merged;
+    merged.reserve(p.latencies.size() + q.latencies.size());
+    std::merge(
+        p.latencies.begin(),
+        p.latencies.end(),
+        q.latencies.begin(),
+        q.latencies.end(),
+        std::back_inserter(merged));
+    p.latencies = std::move(merged);
+    setPercentiles(p);
+  }
+}
+
+std::string TimeSeries::toString(
+    std::string const& indent,
+    std::string const& errors_name) const {
+  double const seconds = std::chrono::duration<double>(interval_).count();
+  std::string ret;
+  for (size_t i = 0; i < points_.size(); i++) {
+    Point const& p = points_[i];
+    char buff[256];
+    // use snprintf as I like the floating point formatting
+    int written = snprintf(
+        buff,
+        sizeof(buff),
+        "t=%7.2fs rps:%8.2fk Bps:%8.2fM %s=%zu",
+        (i + 1) * seconds,
+        p.requests / seconds / 1000.0,
+        p.bytes / seconds / 1000000.0,
+        errors_name.c_str(),
+        p.errors);
+    ret += strcat(
+        ret.empty() ? "" : "\n",
+        indent,
+        std::string(buff, std::clamp<int>(written, 0, sizeof(buff) - 1)),
+        !p.latencies.empty() ? strcat(
+                                   " p50=",
+                                   p.p50.count(),
+                                   "us p99=",
+                                   p.p99.count(),
+                                   "us p100=",
+                                   p.p100.count(),
+                                   "us")
+                             : "");
+  }
+  return ret;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// request, byte and error counts and latency percentiles per fixed interval
+// of a run, so that periodic stalls are not averaged away. only whole
+// intervals are kept
+class TimeSeries {
+ public:
+  using TClock = std::chrono::steady_clock;
+
+  // disabled, sample() and addLatency() do nothing
+  TimeSeries() = default;
+  TimeSeries(std::chrono::milliseconds interval, TClock::time_point start);
+
+  bool enabled() const {
+    return interval_.count() > 0;
+  }
+
+  bool empty() const {
+    return points_.empty();
+  }
+
+  void addLatency(std::chrono::microseconds d) {
+    if (enabled()) {
+      latencies_.push_back(d);
+    }
+  }
+
+  // totals are counted from the start of the run. cheap unless an interval
+  // has ended, so can be called every loop
+  void sample(
+      TClock::time_point now,
+      size_t requests,
+      size_t bytes,
+      size_t errors) {
+    if (enabled() && now >= nextEnd_) {
+      closeIntervals(now, requests, bytes, errors);
+    }
+  }
+
+  // adds up intervals with the same index, for several threads started
+  // together. percentiles are taken again over every thread's latencies
+  void mergeIn(TimeSeries&& o);
+
+  // one line per interval, each starting with indent
+  std::string toString(
+      std::string const& indent,
+      std::string const& errors_name) const;
+
+ private:
+  struct Point {
+    size_t requests = 0;
+    size_t bytes = 0;
+    size_t errors = 0;
+    // sorted, kept so that merged percentiles are exact
+    std::vector<std::chrono::microseconds> latencies;
+    std::chrono::microseconds p50{0};
+    std::chrono::microseconds p99{0};
+    std::chrono::microseconds p100{0};
+  };
+
+  static void setPercentiles(Point& p);
+
+  void closeIntervals(
+      TClock::time_point now,
+      size_t requests,
+      size_t bytes,
+      size_t errors);
+
+  std::chrono::milliseconds interval_{0};
+  TClock::time_point nextEnd_;
+  std::vector<Point> points_;
+  std::vector<std::chrono::microseconds> latencies_;
+  size_t lastRequests_ = 0;
+  size_t lastBytes_ = 0;
+  size_t lastErrors_ = 0;
+};
@@ -0,0 +1,201 @@
+#include "timestamping.h"
+
+#include <errno.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <netinet/in.h>
+#include <time.h>
+
+#include "sender.h"
+#include "util.h"
+
+namespace {
+
+// pending sends that never get an ack timestamp (eg the socket was closed)
+// should not grow without bound
+constexpr size_t kMaxPending = 4096;
+
+uint64_t toNs(struct timespec const& ts) {
+  return ts.tv_sec * 1000000000LLU + ts.tv_nsec;
+}
+
+void addDelta(
+    std::vector<std::chrono::microseconds>& to,
+    uint64_t from_ns,
+    uint64_t to_ns) {
+  // clamp as these come from different sources and might be a touch off
+  to.push_back(std::chrono::microseconds(
+      to_ns > from_ns ? (to_ns - from_ns) / 1000 : 0));
+}
+
+void append(
+    std::vector<std::chrono::microseconds>& to,
+    std::vector<std::chrono::microseconds>&& from) {
+  to.insert(to.end(), from.begin(), from.end());
+  from.clear();
+}
+
+std::string describe(
+    char const* name,
+    std::vector<std::chrono::microseconds> const& d) {
+  if (d.empty()) {
+    return {};
+  }
+  auto copy = d;
+  return strcat(
+      " ", name, "={", LatencyResult::from(std::move(copy)).toString(), "}");
+}
+
+} // namespace
+
+void TimestampStats::mergeIn(TimestampStats&& b) {
+  append(rx_stack, std::move(b.rx_stack));
+  append(tx_sched, std::move(b.tx_sched));
+  append(tx_stack, std::move(b.tx_stack));
+  append(tx_ack, std::move(b.tx_ack));
+}
+
+std::string TimestampStats::toString() const {
+  return strcat(
+      describe("rx_stack", rx_stack),
+      describe("tx_sched", tx_sched),
+      describe("tx_stack", tx_stack),
+      describe("tx_ack", tx_ack));
+}
+
+void SocketTimestamps::enable(int fd) {
+  doSetSockOpt<int>(
+      fd,
+      SOL_SOCKET,
+      SO_TIMESTAMPING,
+      SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+          SOF_TIMESTAMPING_TX_SCHED | SOF_TIMESTAMPING_TX_SOFTWARE |
+          SOF_TIMESTAMPING_TX_ACK | SOF_TIMESTAMPING_OPT_ID |
+          SOF_TIMESTAMPING_OPT_TSONLY);
+}
+
+uint64_t SocketTimestamps::nowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return toNs(ts);
+}
+
+void SocketTimestamps::readRx(
+    struct cmsghdr const* cmsg,
+    TimestampStats& stats) {
+  if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_TIMESTAMPING) {
+    return;
+  }
+  struct scm_timestamping tss;
+  memcpy(&tss, CMSG_DATA(cmsg), sizeof(tss));
+  if (tss.ts[0].tv_sec || tss.ts[0].tv_nsec) {
+    addDelta(stats.rx_stack, toNs(tss.ts[0]), nowNs());
+  }
+}
+
+void SocketTimestamps::readRx(
+    struct msghdr const* msg,
+    TimestampStats& stats) {
+  if (!msg->msg_controllen) {
+    return;
+  }
+  for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(msg); cmsg;
+       cmsg = CMSG_NXTHDR((struct msghdr*)msg, cmsg)) {
+    readRx(cmsg, stats);
+  }
+}
+
+void SocketTimestamps::sent(size_t len, uint64_t sent_ns) {
+  if (!len) {
+    return;
+  }
+  bytes_ += len;
+  pending_.push_back(Pending{bytes_ - 1, sent_ns});
+  if (pending_.size() > kMaxPending) {
+    pending_.pop_front();
+  }
+}
+
+SocketTimestamps::Pending* SocketTimestamps::find(uint32_t id) {
+  for (auto& p : pending_) {
+    if (p.id == id) {
+      return &p;
+    }
+  }
+  return nullptr;
+}
+
+void SocketTimestamps::onTx(
+    uint32_t id,
+    uint32_t type,
+    uint64_t ns,
+    TimestampStats& stats) {
+  if (!haveBase_) {
+    if (pending_.empty()) {
+      return;
+    }
+    base_ = id - pending_.front().id;
+    haveBase_ = true;
+  }
+  Pending* p = find(id - base_);
+  if (!p) {
+    return;
+  }
+  switch (type) {
+    case SCM_TSTAMP_SCHED:
+      p->sched_ns = ns;
+      addDelta(stats.tx_sched, p->sent_ns, ns);
+      break;
+    case SCM_TSTAMP_SND:
+      p->snd_ns = ns;
+      if (p->sched_ns) {
+        addDelta(stats.tx_stack, p->sched_ns, ns);
+      }
+      break;
+    case SCM_TSTAMP_ACK:
+      if (p->snd_ns) {
+        addDelta(stats.tx_ack, p->snd_ns, ns);
+      }
+      // acks are the last we will hear about anything up to here
+      while (!pending_.empty() && &pending_.front() != p) {
+        pending_.pop_front();
+      }
+      pending_.pop_front();
+      break;
+  }
+}
+
+void SocketTimestamps::drainErrQueue(int fd, TimestampStats& stats) {
+  char control[kControlSize];
+  while (true) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    int res = recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+    if (res < 0) {
+      if (errno != EAGAIN && errno != EINTR) {
+        vlog("error queue read failed: ", strerror(errno));
+      }
+      return;
+    }
+    uint64_t ns = 0;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level == SOL_SOCKET &&
+          cmsg->cmsg_type == SCM_TIMESTAMPING) {
+        struct scm_timestamping tss;
+        memcpy(&tss, CMSG_DATA(cmsg), sizeof(tss));
+        ns = toNs(tss.ts[0]);
+      } else if (
+          (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+          (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+        struct sock_extended_err err;
+        memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+        if (err.ee_origin == SO_EE_ORIGIN_TIMESTAMPING && ns) {
+          onTx(err.ee_data, err.ee_info, ns, stats);
+        }
+      }
+    }
+  }
+}
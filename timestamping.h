@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+
+// kernel (SO_TIMESTAMPING) software timestamps, used to split a request's
+// latency into time spent queued in the kernel, traversing the stack, and on
+// the wire vs time spent in the application
+struct TimestampStats {
+  // packet timestamped by the rx stack -> read by the application
+  std::vector<std::chrono::microseconds> rx_stack;
+  // send call -> packet handed to the qdisc
+  std::vector<std::chrono::microseconds> tx_sched;
+  // qdisc -> packet handed to the device
+  std::vector<std::chrono::microseconds> tx_stack;
+  // device -> data acked by the peer
+  std::vector<std::chrono::microseconds> tx_ack;
+
+  bool empty() const {
+    return rx_stack.empty() && tx_sched.empty() && tx_stack.empty() &&
+        tx_ack.empty();
+  }
+  void mergeIn(TimestampStats&& b);
+  std::string toString() const;
+};
+
+class SocketTimestamps {
+ public:
+  // enable software rx and tx (sched, software, ack) timestamps on fd, which
+  // must be a connected (or accepted) tcp socket
+  static void enable(int fd);
+
+  // space needed in msg_control to receive rx timestamps
+  static constexpr size_t kControlSize = 256;
+
+  // pull rx timestamps out of a recvmsg result
+  static void readRx(struct msghdr const* msg, TimestampStats& stats);
+  static void readRx(struct cmsghdr const* cmsg, TimestampStats& stats);
+
+  // record that len bytes were passed to a successful send call at
+  // (CLOCK_REALTIME) time sent_ns, so that tx timestamps can be matched
+  void sent(size_t len, uint64_t sent_ns);
+  void sent(size_t len) {
+    sent(len, nowNs());
+  }
+
+  // read any tx timestamps from the socket error queue
+  void drainErrQueue(int fd, TimestampStats& stats);
+
+  static uint64_t nowNs();
+
+ private:
+  struct Pending {
+    uint32_t id;
+    uint64_t sent_ns;
+    uint64_t sched_ns = 0;
+    uint64_t snd_ns = 0;
+  };
+
+  Pending* find(uint32_t id);
+  void onTx(uint32_t id, uint32_t type, uint64_t ns, TimestampStats& stats);
+
+  // tcp timestamp ids are the sequence number of the last byte in each send,
+  // relative to wherever the socket was when timestamping was enabled. this
+  // is not known if anything was sent before then, so line up on the first
+  // report
+  uint32_t bytes_ = 0;
+  bool haveBase_ = false;
+  uint32_t base_ = 0;
+  std::deque<Pending> pending_;
+};
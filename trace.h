@@ -0,0 +1,38 @@
+#pragma once
+
+/*
+ * Static tracepoints (USDT) at the hot path sites, for perf and bpftrace.
+ * They show up as sdt_netbench:<name>, for example
+ *   perf buildid-cache --add ./netbench
+ *   perf probe 'sdt_netbench:*'
+ *   perf record -e 'sdt_netbench:*' ./netbench ...
+ * profile.sh does this, and splits the profile up by them. Without
+ * sys/sdt.h (systemtap-sdt-dev / systemtap-sdt-devel) they compile to
+ * nothing, and when not being traced they are a single nop.
+ */
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define NETBENCH_HAVE_SDT 1
+#endif
+#endif
+
+#ifdef NETBENCH_HAVE_SDT
+#define NETBENCH_TRACE(name) DTRACE_PROBE(netbench, name)
+#define NETBENCH_TRACE1(name, a) DTRACE_PROBE1(netbench, name, a)
+#define NETBENCH_TRACE2(name, a, b) DTRACE_PROBE2(netbench, name, a, b)
+#else
+#define NETBENCH_TRACE(name) \
+  do {                       \
+  } while (0)
+#define NETBENCH_TRACE1(name, a) \
+  do {                           \
+    (void)(a);                   \
+  } while (0)
+#define NETBENCH_TRACE2(name, a, b) \
+  do {                              \
+    (void)(a);                      \
+    (void)(b);                      \
+  } while (0)
+#endif
@@ -1,11 +1,14 @@
 #include "util.h"
 
+#include <algorithm>
 #include <atomic>
+#include <mutex>
 #include <fcntl.h>
 #include <stdio.h>
-#include <sys/syscall.h>
 #include <sys/types.h>
 
+#include "trace.h"
+
 namespace po = boost::program_options;
 
 float logTime() {
@@ -51,40 +54,83 @@ boost::program_options::variables_map simpleParse(
   return vm;
 }
 
-void checkHugePages(int count) {
-  static int already_checked = 0;
-
-  count = already_checked = (already_checked + count);
+namespace {
 
-  int file = open("/proc/sys/vm/nr_hugepages", O_RDWR);
-  if (file < 0) {
-    die("unable to open /proc/sys/vm/nr_hugepages");
-  }
+std::mutex hugePagesMutex;
+// pages mapped by this process, and nr_hugepages before it changed it
+int hugePagesReserved = 0;
+int hugePagesInitial = -1;
 
+int readNrHugePages(int file) {
   char buff[128];
   buff[sizeof(buff) - 1] = '\0';
-  int res = read(file, &buff, sizeof(buff) - 1);
+  int res = pread(file, &buff, sizeof(buff) - 1, 0);
   if (res <= 0) {
     die("unable to read number of pages");
   }
-
   int val;
   if (sscanf(buff, "%d", &val) != 1) {
     die("unable to parse:", buff);
   }
+  return val;
+}
+
+void writeNrHugePages(int file, int count) {
+  char buff[128];
+  int n = snprintf(buff, sizeof(buff), "%d\n", count);
+  int res = pwrite(file, buff, n, 0);
+  if (res != n) {
+    log("unable to write ",
+        buff,
+        " len=",
+        n,
+        " to /proc/sys/vm/nr_hugepages, "
+        "this might not work res=",
+        res);
+  }
+}
+
+} // namespace
+
+void reserveHugePages(int count) {
+  std::lock_guard<std::mutex> lock(hugePagesMutex);
+  hugePagesReserved += count;
+
+  int file = open("/proc/sys/vm/nr_hugepages", O_RDWR);
+  if (file < 0) {
+    die("unable to open /proc/sys/vm/nr_hugepages");
+  }
+  int val = readNrHugePages(file);
   vlog("have ", val, " huge pages available");
-  if (val < count) {
-    int n = snprintf(buff, sizeof(buff), "%d\n", count);
-    res = pwrite(file, buff, n, 0);
-    if (res != n) {
-      log("unable to write ",
-          buff,
-          " len=",
-          n,
-          " to /proc/sys/vm/nr_hugepages, "
-          "this might not work res=",
-          res);
+  if (val < hugePagesReserved) {
+    if (hugePagesInitial < 0) {
+      hugePagesInitial = val;
     }
+    writeNrHugePages(file, hugePagesReserved);
+  }
+  close(file);
+}
+
+void releaseHugePages(int count) {
+  std::lock_guard<std::mutex> lock(hugePagesMutex);
+  hugePagesReserved -= count;
+  if (hugePagesInitial < 0) {
+    // never grew the pool, so nothing to give back
+    return;
+  }
+
+  int file = open("/proc/sys/vm/nr_hugepages", O_RDWR);
+  if (file < 0) {
+    log("unable to open /proc/sys/vm/nr_hugepages");
+    return;
+  }
+  // shrink back towards what it was, but not below what is still mapped
+  int const want = std::max(hugePagesInitial, hugePagesReserved);
+  if (readNrHugePages(file) > want) {
+    writeNrHugePages(file, want);
+  }
+  if (want == hugePagesInitial) {
+    hugePagesInitial = -1;
   }
   close(file);
 }
@@ -106,7 +152,7 @@ void runWorkload(unsigned int outer, unsigned int inner) {
     size_t loops = 0;
     auto start = std::chrono::steady_clock::now();
     auto end = start + std::chrono::microseconds(inner);
-    syscall(99999999);
+    NETBENCH_TRACE1(workload_start, inner);
     do {
       loops++;
 #ifdef __i386__
@@ -115,7 +161,7 @@ void runWorkload(unsigned int outer, unsigned int inner) {
       asm volatile("yield");.
 #endif
     } while (std::chrono::steady_clock::now() < end);
-    syscall(99999999);
+    NETBENCH_TRACE1(workload_end, loops);
     vlog(
         "took ",
         std::chrono::duration_cast<std::chrono::microseconds>(
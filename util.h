@@ -112,6 +112,9 @@ boost::program_options::variables_map simpleParse(
     boost::program_options::options_description desc,
     std::vector<std::string> const& splits);
 
-void checkHugePages(int count);
+// grow /proc/sys/vm/nr_hugepages to cover the huge pages this process has
+// mapped, and shrink it back (never below where it started) as they go
+void reserveHugePages(int count);
+void releaseHugePages(int count);
 std::string hexdump(void const* p, size_t n);
 void runWorkload(unsigned int outer, unsigned int inner);